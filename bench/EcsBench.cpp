@@ -0,0 +1,414 @@
+// Headless micro-benchmarks for the ECS.
+//
+// Usage: 2dge_bench [--sizes 1000,100000,1000000] [--reps 5]
+//                   [--out results.json] [--baseline baseline.json]
+//                   [--threshold 10]
+//
+// Results are written as JSON (to stdout unless --out is given). When a
+// baseline produced by a previous run is given, every benchmark is
+// compared against it and the process exits with 1 if any of them got
+// slower than the threshold (in percent).
+
+#include "ECS/ECS.h"
+#include "Logger/Logger.h"
+#include "Components/TransformComponent.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Constructors rather than aggregates: AddComponent forwards its
+// arguments with parentheses, which only C++20 allows for aggregates.
+struct VelocityComponent {
+    glm::vec2 velocity;
+
+    VelocityComponent(glm::vec2 velocity = glm::vec2(0.0f)) : velocity(velocity) {}
+};
+
+struct HealthComponent {
+    int health;
+
+    HealthComponent(int health = 100) : health(health) {}
+};
+
+struct TeamComponent {
+    int team;
+
+    TeamComponent(int team = 0) : team(team) {}
+};
+
+// Tag for entities that never move.
+struct StaticComponent {};
+
+// Systems reading 1 to 4 components, used to measure iteration.
+struct ViewSystem1: public System {
+    ViewSystem1() { RequireComponent<TransformComponent>(); }
+};
+
+struct ViewSystem2: public System {
+    ViewSystem2() {
+        RequireComponent<TransformComponent>();
+        RequireComponent<VelocityComponent>();
+    }
+};
+
+struct ViewSystem3: public System {
+    ViewSystem3() {
+        RequireComponent<TransformComponent>();
+        RequireComponent<VelocityComponent>();
+        RequireComponent<HealthComponent>();
+    }
+};
+
+struct ViewSystem4: public System {
+    ViewSystem4() {
+        RequireComponent<TransformComponent>();
+        RequireComponent<VelocityComponent>();
+        RequireComponent<HealthComponent>();
+        RequireComponent<TeamComponent>();
+    }
+};
+
+struct MovingSystem: public System {
+    MovingSystem() {
+        RequireComponent<TransformComponent>();
+        RequireComponent<Without<StaticComponent>>();
+    }
+};
+
+struct BenchResult {
+    std::string name;
+    int entities;
+    size_t ops;
+    double medianNsPerOp;
+    double minNsPerOp;
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double ElapsedNs(Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+// Every benchmark fills a fresh registry (not timed) and then returns the
+// time in nanoseconds spent in the measured part and how many operations
+// it performed.
+struct Sample {
+    double ns;
+    size_t ops;
+};
+
+static std::vector<Entity> Populate(Registry& registry, int count, int numComponents) {
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> coord(0.0f, 1920.0f);
+    std::vector<Entity> entities;
+    entities.reserve(count);
+    for (int i = 0; i < count; i++) {
+        Entity entity = registry.CreateEntity();
+        registry.AddComponent<TransformComponent>(entity, glm::vec2(coord(rng), coord(rng)));
+        if (numComponents > 1) registry.AddComponent<VelocityComponent>(entity, glm::vec2(1.0f, 0.5f));
+        if (numComponents > 2) registry.AddComponent<HealthComponent>(entity);
+        if (numComponents > 3) registry.AddComponent<TeamComponent>(entity, i % 2);
+        entities.push_back(entity);
+    }
+    return entities;
+}
+
+static Sample BenchCreateDestroyChurn(int count) {
+    Registry registry;
+    registry.AddSystem<ViewSystem2>();
+    std::vector<Entity> entities = Populate(registry, count, 2);
+    registry.Update();
+
+    std::mt19937 rng(42);
+    const int churnPerRound = std::max(1, count / 10);
+    const int rounds = 5;
+
+    auto start = Clock::now();
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < churnPerRound; i++) {
+            const size_t victim = rng() % entities.size();
+            registry.KillEntity(entities[victim]);
+            Entity entity = registry.CreateEntity();
+            registry.AddComponent<TransformComponent>(entity);
+            registry.AddComponent<VelocityComponent>(entity, glm::vec2(1.0f, 0.0f));
+            entities[victim] = entity;
+        }
+        registry.Update();
+    }
+    return {ElapsedNs(start), size_t(churnPerRound) * rounds};
+}
+
+static Sample BenchAddRemoveComponent(int count) {
+    Registry registry;
+    std::vector<Entity> entities = Populate(registry, count, 1);
+    registry.Update();
+
+    auto start = Clock::now();
+    for (auto entity : entities) {
+        registry.AddComponent<HealthComponent>(entity, 50);
+    }
+    for (auto entity : entities) {
+        registry.RemoveComponent<HealthComponent>(entity);
+    }
+    return {ElapsedNs(start), entities.size() * 2};
+}
+
+template <typename TSystem, int NumComponents>
+static Sample BenchIterateView(int count) {
+    Registry registry;
+    registry.AddSystem<TSystem>();
+    Populate(registry, count, 4);
+    registry.Update();
+
+    // Enough passes for small sizes to run long enough to be stable.
+    const int passes = std::max(5, 1000000 / count);
+    const float deltaT = 1.0f / 120.0f;
+    volatile float sink = 0.0f;
+    // Let the log writer catch up with the spawns so it doesn't compete
+    // with the loop being measured.
+    Logger::Flush();
+    auto start = Clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        for (auto entity : registry.GetSystem<TSystem>().GetEntities()) {
+            auto& transform = registry.GetComponent<TransformComponent>(entity);
+            if constexpr (NumComponents > 1) {
+                transform.position += registry.GetComponent<VelocityComponent>(entity).velocity * deltaT;
+            }
+            if constexpr (NumComponents > 2) {
+                registry.GetComponent<HealthComponent>(entity).health -= 1;
+            }
+            if constexpr (NumComponents > 3) {
+                transform.rotation += registry.GetComponent<TeamComponent>(entity).team;
+            }
+            sink = sink + transform.position.x;
+        }
+    }
+    return {ElapsedNs(start), size_t(count) * passes};
+}
+
+static Sample BenchSystemMembership(int count) {
+    Registry registry;
+    registry.AddSystem<ViewSystem1>();
+    registry.AddSystem<ViewSystem2>();
+    registry.AddSystem<ViewSystem3>();
+    registry.AddSystem<ViewSystem4>();
+    Populate(registry, count, 4);
+
+    // The entities get matched against every system on the first Update.
+    auto start = Clock::now();
+    registry.Update();
+    return {ElapsedNs(start), size_t(count)};
+}
+
+static Sample BenchKillBatch(int count) {
+    Registry registry;
+    registry.AddSystem<ViewSystem1>();
+    registry.AddSystem<ViewSystem4>();
+    std::vector<Entity> entities = Populate(registry, count, 4);
+    registry.Update();
+
+    std::mt19937 rng(7);
+    std::shuffle(entities.begin(), entities.end(), rng);
+    const size_t numKilled = entities.size() / 2;
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < numKilled; i++) {
+        registry.KillEntity(entities[i]);
+    }
+    registry.Update();
+    return {ElapsedNs(start), numKilled};
+}
+
+// Tags half the entities as static after they joined their systems and
+// untags them again, each followed by the Update that moves them between
+// systems. Exits if they don't end up where they belong.
+static Sample BenchRetagMembership(int count) {
+    Registry registry;
+    registry.AddSystem<ViewSystem1>();
+    registry.AddSystem<MovingSystem>();
+    std::vector<Entity> entities = Populate(registry, count, 1);
+    registry.Update();
+    const size_t numTagged = entities.size() / 2;
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < numTagged; i++) {
+        registry.AddComponent<StaticComponent>(entities[i]);
+    }
+    registry.Update();
+    const size_t numMovingTagged = registry.GetSystem<MovingSystem>().GetEntities().size();
+    for (size_t i = 0; i < numTagged; i++) {
+        registry.RemoveComponent<StaticComponent>(entities[i]);
+    }
+    registry.Update();
+    const double ns = ElapsedNs(start);
+
+    const size_t numMoving = registry.GetSystem<MovingSystem>().GetEntities().size();
+    if (numMovingTagged != entities.size() - numTagged || numMoving != entities.size() ||
+        registry.GetSystem<ViewSystem1>().GetEntities().size() != entities.size()) {
+        std::cerr << "retag_membership: " << numMovingTagged << " moving entities after tagging and "
+                  << numMoving << " after untagging, expected " << entities.size() - numTagged
+                  << " and " << entities.size() << std::endl;
+        std::exit(1);
+    }
+    return {ns, numTagged * 2};
+}
+
+static BenchResult Run(const std::string& name, Sample (*bench)(int), int count, int reps) {
+    std::vector<double> nsPerOp;
+    size_t ops = 0;
+    for (int rep = 0; rep < reps; rep++) {
+        Sample sample = bench(count);
+        ops = sample.ops;
+        nsPerOp.push_back(sample.ns / double(std::max<size_t>(sample.ops, 1)));
+    }
+    std::sort(nsPerOp.begin(), nsPerOp.end());
+    std::cerr << name << " @ " << count << ": " << nsPerOp[nsPerOp.size() / 2] << " ns/op" << std::endl;
+    return {name, count, ops, nsPerOp[nsPerOp.size() / 2], nsPerOp.front()};
+}
+
+static std::string ToJson(const std::vector<BenchResult>& results) {
+    std::ostringstream out;
+    out << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& r = results[i];
+        // One benchmark per line, LoadBaseline relies on it.
+        out << "    {\"name\": \"" << r.name << "\", \"entities\": " << r.entities
+            << ", \"ops\": " << r.ops
+            << ", \"median_ns_per_op\": " << r.medianNsPerOp
+            << ", \"min_ns_per_op\": " << r.minNsPerOp << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return out.str();
+}
+
+static bool ExtractField(const std::string& line, const std::string& key, std::string& value) {
+    const std::string pattern = "\"" + key + "\": ";
+    size_t pos = line.find(pattern);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    pos += pattern.size();
+    if (line[pos] == '"') {
+        const size_t end = line.find('"', pos + 1);
+        value = line.substr(pos + 1, end - pos - 1);
+    } else {
+        const size_t end = line.find_first_of(",}", pos);
+        value = line.substr(pos, end - pos);
+    }
+    return true;
+}
+
+static std::vector<BenchResult> LoadBaseline(const std::string& path) {
+    std::vector<BenchResult> baseline;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::string name, entities, median;
+        if (ExtractField(line, "name", name) &&
+            ExtractField(line, "entities", entities) &&
+            ExtractField(line, "median_ns_per_op", median)) {
+            baseline.push_back({name, std::stoi(entities), 0, std::stod(median), 0.0});
+        }
+    }
+    return baseline;
+}
+
+// Prints the relative change of every benchmark and returns false if any
+// of them regressed more than thresholdPercent.
+static bool CompareToBaseline(const std::vector<BenchResult>& results, const std::vector<BenchResult>& baseline, double thresholdPercent) {
+    bool ok = true;
+    for (const auto& result : results) {
+        auto match = std::find_if(baseline.begin(), baseline.end(), [&result](const BenchResult& b) {
+            return b.name == result.name && b.entities == result.entities;
+        });
+        if (match == baseline.end()) {
+            std::cerr << "  " << result.name << " @ " << result.entities << ": not in baseline" << std::endl;
+            continue;
+        }
+        const double change = (result.medianNsPerOp - match->medianNsPerOp) / match->medianNsPerOp * 100.0;
+        const bool regressed = change > thresholdPercent;
+        ok = ok && !regressed;
+        char buffer[160];
+        std::snprintf(buffer, sizeof(buffer), "  %-28s @ %8d: %10.2f -> %10.2f ns/op (%+.1f%%)%s",
+                      result.name.c_str(), result.entities, match->medianNsPerOp, result.medianNsPerOp,
+                      change, regressed ? "  REGRESSION" : "");
+        std::cerr << buffer << std::endl;
+    }
+    return ok;
+}
+
+static std::vector<int> ParseSizes(const std::string& list) {
+    std::vector<int> sizes;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        sizes.push_back(std::stoi(item));
+    }
+    return sizes;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<int> sizes = {1000, 100000, 1000000};
+    int reps = 5;
+    std::string outPath;
+    std::string baselinePath;
+    double thresholdPercent = 10.0;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--sizes" && hasValue) sizes = ParseSizes(argv[++i]);
+        else if (arg == "--reps" && hasValue) reps = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--out" && hasValue) outPath = argv[++i];
+        else if (arg == "--baseline" && hasValue) baselinePath = argv[++i];
+        else if (arg == "--threshold" && hasValue) thresholdPercent = std::atof(argv[++i]);
+        else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    // Discard the log output so the terminal doesn't end up being what
+    // gets measured if the registry's trace logs are compiled in and
+    // enabled.
+    Logger::SetOutput(nullptr);
+
+    std::vector<BenchResult> results;
+    for (int count : sizes) {
+        results.push_back(Run("create_destroy_churn", BenchCreateDestroyChurn, count, reps));
+        results.push_back(Run("add_remove_component", BenchAddRemoveComponent, count, reps));
+        results.push_back(Run("iterate_view_1", BenchIterateView<ViewSystem1, 1>, count, reps));
+        results.push_back(Run("iterate_view_2", BenchIterateView<ViewSystem2, 2>, count, reps));
+        results.push_back(Run("iterate_view_3", BenchIterateView<ViewSystem3, 3>, count, reps));
+        results.push_back(Run("iterate_view_4", BenchIterateView<ViewSystem4, 4>, count, reps));
+        results.push_back(Run("system_membership_rebuild", BenchSystemMembership, count, reps));
+        results.push_back(Run("kill_batch", BenchKillBatch, count, reps));
+        results.push_back(Run("retag_membership", BenchRetagMembership, count, reps));
+    }
+
+    Logger::SetOutput(stdout);
+
+    const std::string json = ToJson(results);
+    if (outPath.empty()) {
+        std::cout << json;
+    } else {
+        std::ofstream(outPath) << json;
+    }
+
+    if (!baselinePath.empty()) {
+        std::cerr << "Comparing against " << baselinePath << " (threshold " << thresholdPercent << "%):" << std::endl;
+        if (!CompareToBaseline(results, LoadBaseline(baselinePath), thresholdPercent)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "AssetArchive.h"
+#include "../Logger/Logger.h"
+#include <algorithm>
+#include <cstring>
+
+AssetArchive::AssetArchive() : m_entries(nullptr), m_numEntries(0) {
+}
+
+AssetArchive::~AssetArchive() {
+    Close();
+}
+
+bool AssetArchive::Open(const std::string& path) {
+    Close();
+    // Pages only get read in when a texture is created from them.
+    if (!m_file.Open(path)) {
+        Logger::Err("Could not open the asset archive " + path);
+        return false;
+    }
+    if (!Validate(path)) {
+        Close();
+        return false;
+    }
+    Logger::Log("Opened the asset archive " + path + " with " + std::to_string(m_numEntries) + " assets");
+    return true;
+}
+
+// Checks everything Find and GetData rely on, so a truncated or foreign
+// file can't make them read outside the archive. The baker aligns every
+// entry to ARCHIVE_ALIGNMENT, which the pixels and tile ids get read in
+// place with (the mapping itself starts on a page).
+bool AssetArchive::Validate(const std::string& path) {
+    const uint8_t* data = m_file.GetData();
+    const uint64_t size = m_file.GetSize();
+    ArchiveHeader header;
+    bool ok = size >= sizeof(header);
+    if (ok) {
+        memcpy(&header, data, sizeof(header));
+        ok = memcmp(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) == 0 &&
+            header.version == ARCHIVE_VERSION &&
+            header.fileSize == size &&
+            header.indexOffset % alignof(ArchiveEntry) == 0 &&
+            header.indexOffset <= size &&
+            header.numEntries <= (size - header.indexOffset) / sizeof(ArchiveEntry);
+    }
+    if (!ok) {
+        Logger::Err(path + " is not an asset archive of this version");
+        return false;
+    }
+    m_entries = reinterpret_cast<const ArchiveEntry*>(data + header.indexOffset);
+    m_numEntries = header.numEntries;
+    for (uint32_t i = 0; i < m_numEntries; i++) {
+        const ArchiveEntry& entry = m_entries[i];
+        uint64_t expectedSize = entry.size;
+        if (entry.type == ARCHIVE_IMAGE) {
+            expectedSize = uint64_t(entry.width) * entry.height * 4;
+        } else if (entry.type == ARCHIVE_TILEMAP) {
+            expectedSize = uint64_t(entry.width) * entry.height * sizeof(uint16_t);
+        }
+        const bool valid = memchr(entry.name, '\0', sizeof(entry.name)) != nullptr &&
+            (i == 0 || strcmp(m_entries[i - 1].name, entry.name) < 0) &&
+            entry.offset % ARCHIVE_ALIGNMENT == 0 &&
+            entry.offset <= size && entry.size <= size - entry.offset &&
+            entry.size == expectedSize;
+        if (!valid) {
+            Logger::Err(path + " has a broken index entry");
+            return false;
+        }
+    }
+    return true;
+}
+
+void AssetArchive::Close() {
+    m_file.Close();
+    m_entries = nullptr;
+    m_numEntries = 0;
+}
+
+const ArchiveEntry* AssetArchive::Find(std::string_view name) const {
+    const ArchiveEntry* end = m_entries + m_numEntries;
+    const ArchiveEntry* entry = std::lower_bound(m_entries, end, name, [](const ArchiveEntry& a, std::string_view b) {
+        return std::string_view(a.name) < b;
+    });
+    return entry != end && std::string_view(entry->name) == name ? entry : nullptr;
+}
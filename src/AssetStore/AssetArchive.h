@@ -0,0 +1,77 @@
+#ifndef ASSET_ARCHIVE_H
+#define ASSET_ARCHIVE_H
+
+#include "MappedFile.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// A single file holding the assets baked by 2dge_assetbaker, ready to be
+// used as they are: images as raw pixels in the format the textures get
+// created in, tilemaps as a grid of tile ids, anything else (fonts) as
+// its bytes. The game maps it into memory and creates its textures
+// straight from the mapped pixels, nothing is decoded at runtime.
+//
+// Layout, everything in the host's byte order: the header, the entries'
+// data each aligned to ARCHIVE_ALIGNMENT, then the index of
+// numEntries entries sorted by name.
+static const char ARCHIVE_MAGIC[8] = {'2', 'D', 'G', 'E', 'P', 'A', 'C', 'K'};
+static const uint32_t ARCHIVE_VERSION = 1;
+static const uint64_t ARCHIVE_ALIGNMENT = 64;
+
+enum ArchiveEntryType : uint32_t {
+    // width x height pixels of 4 bytes in the SDL_PixelFormatEnum format,
+    // rows packed without padding.
+    ARCHIVE_IMAGE = 1,
+    // width (columns) x height (rows) uint16_t tile ids, row by row.
+    ARCHIVE_TILEMAP = 2,
+    // The file as it was.
+    ARCHIVE_FILE = 3,
+};
+
+struct ArchiveHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t numEntries;
+    uint64_t indexOffset;
+    uint64_t fileSize;
+};
+
+struct ArchiveEntry {
+    // Path relative to the baked directory with '/' separators, for
+    // example "images/tree.png". Null terminated.
+    char name[48];
+    uint32_t type;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset;
+    uint64_t size;
+};
+
+class AssetArchive {
+    private:
+        MappedFile m_file;
+        const ArchiveEntry* m_entries;
+        uint32_t m_numEntries;
+
+        bool Validate(const std::string& path);
+
+    public:
+        AssetArchive();
+        ~AssetArchive();
+        AssetArchive(const AssetArchive&) = delete;
+        AssetArchive& operator=(const AssetArchive&) = delete;
+
+        bool Open(const std::string& path);
+        // Pointers into the archive become invalid.
+        void Close();
+        bool IsOpen() const { return m_file.IsOpen(); }
+
+        // Binary search of the index, nullptr if name isn't in it.
+        const ArchiveEntry* Find(std::string_view name) const;
+        const uint8_t* GetData(const ArchiveEntry& entry) const { return m_file.GetData() + entry.offset; }
+        uint32_t GetNumEntries() const { return m_numEntries; }
+};
+
+#endif
@@ -0,0 +1,442 @@
+#include "AssetStore.h"
+#include "TextureAtlas.h"
+#include "../Logger/Logger.h"
+#include "../Profiler/Profiler.h"
+#include <SDL2/SDL_image.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+static double MsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Calls work(0) .. work(count - 1) spread over up to numThreads threads,
+// the calling one included. Returns the number of threads used.
+template <typename TWork>
+static int ParallelFor(size_t count, int numThreads, TWork&& work) {
+    numThreads = std::max(1, std::min<int>(numThreads, int(count)));
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+            work(i);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < numThreads; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return numThreads;
+}
+
+// Big enough for all the sprites of a level, small enough for any GPU.
+static const int DEFAULT_ATLAS_PAGE_SIZE = 2048;
+// Gap between packed images so linear filtering doesn't sample the
+// neighbours.
+static const int ATLAS_PADDING = 1;
+
+AssetStore::AssetStore() : m_renderer(nullptr), m_atlasPageSize(DEFAULT_ATLAS_PAGE_SIZE) {
+}
+
+AssetStore::~AssetStore() {
+    Clear();
+}
+
+void AssetStore::Initialize(SDL_Renderer* renderer) {
+    m_renderer = renderer;
+    SetAtlasPageSize(m_atlasPageSize);
+}
+
+bool AssetStore::OpenArchive(const std::string& path, const std::string& rootDir) {
+    m_archiveRoot = rootDir;
+    return m_archive.Open(path);
+}
+
+const ArchiveEntry* AssetStore::FindArchived(const std::string& filePath) const {
+    if (!m_archive.IsOpen() || filePath.compare(0, m_archiveRoot.size(), m_archiveRoot) != 0) {
+        return nullptr;
+    }
+    return m_archive.Find(std::string_view(filePath).substr(m_archiveRoot.size()));
+}
+
+bool AssetStore::WatchForChanges(const std::string& rootDir) {
+    return m_watcher.Start(rootDir);
+}
+
+int AssetStore::ApplyReloads() {
+    if (!m_watcher.IsRunning()) {
+        return 0;
+    }
+    m_changes.clear();
+    m_tilemapChanges.clear();
+    m_watcher.TakeChanges(m_changes);
+    int numReloaded = 0;
+    for (AssetWatcher::Change& change : m_changes) {
+        if (!change.surface && !change.tilemap) {
+            Logger::Err("Error reloading " + change.filePath + ": " + change.error);
+            continue;
+        }
+        if (change.tilemap) {
+            m_tilemapChanges.push_back(std::move(change));
+            continue;
+        }
+        for (TextureEntry& entry : m_textures) {
+            if (entry.region.texture && entry.filePath == change.filePath && ReplaceTexture(entry, change.surface)) {
+                Logger::Log("Reloaded texture " + entry.assetId + " from " + entry.filePath);
+                numReloaded++;
+            }
+        }
+        SDL_FreeSurface(change.surface);
+    }
+    return numReloaded;
+}
+
+std::unique_ptr<Tilemap> AssetStore::TakeReloadedTilemap(const std::string& filePath) {
+    for (AssetWatcher::Change& change : m_tilemapChanges) {
+        if (change.tilemap && change.filePath == filePath) {
+            return std::move(change.tilemap);
+        }
+    }
+    return nullptr;
+}
+
+bool AssetStore::ReplaceTexture(TextureEntry& entry, SDL_Surface* surface) {
+    PROFILE_SCOPE("AssetStore::ReplaceTexture");
+    // An image that kept its size is written over its place on the page.
+    const SDL_Rect& rect = entry.region.rect;
+    if (entry.atlasPage >= 0 && surface->w == rect.w && surface->h == rect.h) {
+        Uint32 format;
+        SDL_QueryTexture(entry.region.texture, &format, nullptr, nullptr, nullptr);
+        SDL_Surface* converted = SDL_ConvertSurfaceFormat(surface, format, 0);
+        const bool ok = converted &&
+            SDL_UpdateTexture(entry.region.texture, &rect, converted->pixels, converted->pitch) == 0;
+        SDL_FreeSurface(converted);
+        if (ok) {
+            return true;
+        }
+    }
+
+    // Otherwise the image moves to a texture of its own.
+    SDL_Texture* texture = SDL_CreateTextureFromSurface(m_renderer, surface);
+    if (!texture) {
+        Logger::Err("Error creating texture from " + entry.filePath + ": " + SDL_GetError());
+        return false;
+    }
+    ReleaseRegion(entry);
+    entry.region.texture = texture;
+    entry.region.rect = {0, 0, surface->w, surface->h};
+    return true;
+}
+
+void AssetStore::SetAtlasPageSize(int size) {
+    m_atlasPageSize = std::max(size, 0);
+    SDL_RendererInfo info;
+    if (m_renderer && SDL_GetRendererInfo(m_renderer, &info) == 0) {
+        // 0 means the renderer has no limit.
+        if (info.max_texture_width > 0) {
+            m_atlasPageSize = std::min(m_atlasPageSize, info.max_texture_width);
+        }
+        if (info.max_texture_height > 0) {
+            m_atlasPageSize = std::min(m_atlasPageSize, info.max_texture_height);
+        }
+    }
+}
+
+void AssetStore::Clear() {
+    m_watcher.Stop();
+    m_tilemapChanges.clear();
+    for (size_t slot = 0; slot < m_textures.size(); slot++) {
+        if (m_textures[slot].used) {
+            Unload(uint16_t(slot));
+        }
+    }
+    m_pendingSlots.clear();
+    m_pendingJobs.clear();
+}
+
+TextureHandle AssetStore::QueueTexture(const std::string& assetId, const std::string& filePath) {
+    auto cached = m_handlesById.find(assetId);
+    if (cached != m_handlesById.end()) {
+        m_textures[(cached->second & 0xffff) - 1].refCount++;
+        return cached->second;
+    }
+
+    uint16_t slot;
+    if (!m_freeSlots.empty()) {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    } else if (m_textures.size() < 0xffff) {
+        slot = uint16_t(m_textures.size());
+        m_textures.emplace_back();
+    } else {
+        Logger::Err("Out of texture handles loading " + filePath);
+        return 0;
+    }
+
+    TextureEntry& entry = m_textures[slot];
+    entry.assetId = assetId;
+    entry.filePath = filePath;
+    entry.refCount = 1;
+    entry.used = true;
+    const TextureHandle handle = (TextureHandle(entry.generation) << 16) | (slot + 1);
+    m_handlesById.emplace(assetId, handle);
+    m_pendingSlots.push_back(slot);
+    return handle;
+}
+
+void AssetStore::QueueJob(std::function<void()> job) {
+    m_pendingJobs.push_back(std::move(job));
+}
+
+AssetLoadStats AssetStore::LoadQueued() {
+    PROFILE_SCOPE("AssetStore::LoadQueued");
+    AssetLoadStats stats;
+    // Slots can't move while the workers run, they only read the paths.
+    std::vector<uint16_t> slots;
+    slots.swap(m_pendingSlots);
+    std::vector<std::function<void()>> jobs;
+    jobs.swap(m_pendingJobs);
+    if (slots.empty() && jobs.empty()) {
+        return stats;
+    }
+
+    // IMG_Load only touches the surface it returns, so any number of
+    // images can be decoded at once. Jobs go first as they tend to be
+    // the longer ones.
+    auto decodeStart = std::chrono::steady_clock::now();
+    std::vector<SDL_Surface*> surfaces(slots.size(), nullptr);
+    // SDL keeps the error message per thread.
+    std::vector<std::string> errors(slots.size());
+    const size_t numTasks = jobs.size() + slots.size();
+    stats.numThreads = ParallelFor(numTasks, std::thread::hardware_concurrency(), [&](size_t task) {
+        if (task < jobs.size()) {
+            PROFILE_SCOPE("AssetStore::Job");
+            jobs[task]();
+        } else {
+            PROFILE_SCOPE("AssetStore::DecodeImage");
+            const size_t i = task - jobs.size();
+            const std::string& filePath = m_textures[slots[i]].filePath;
+            const ArchiveEntry* archived = FindArchived(filePath);
+            if (archived && archived->type == ARCHIVE_IMAGE) {
+                // Refers to the mapped pixels, SDL never writes through it.
+                surfaces[i] = SDL_CreateRGBSurfaceWithFormatFrom(
+                    const_cast<uint8_t*>(m_archive.GetData(*archived)),
+                    int(archived->width), int(archived->height), 32, int(archived->width) * 4, archived->format
+                );
+                if (!surfaces[i]) {
+                    errors[i] = SDL_GetError();
+                }
+            } else {
+                surfaces[i] = IMG_Load(filePath.c_str());
+                if (!surfaces[i]) {
+                    errors[i] = IMG_GetError();
+                }
+            }
+        }
+    });
+    stats.decodeMs = MsSince(decodeStart);
+    stats.numJobs = int(jobs.size());
+
+    // Textures can only be created on the thread that owns the renderer.
+    auto uploadStart = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (!surfaces[i]) {
+            Logger::Err("Error loading texture " + m_textures[slots[i]].filePath + ": " + errors[i]);
+            Unload(slots[i]);
+        }
+    }
+    const size_t numPages = GetNumAtlasPages();
+    stats.numTextures = UploadTextures(slots, surfaces);
+    stats.numAtlasPages = int(GetNumAtlasPages() - numPages);
+    stats.uploadMs = MsSince(uploadStart);
+    return stats;
+}
+
+int AssetStore::UploadTextures(const std::vector<uint16_t>& slots, std::vector<SDL_Surface*>& surfaces) {
+    int numUploaded = 0;
+    auto finish = [&](uint16_t slot, SDL_Texture* texture, int atlasPage, SDL_Rect rect) {
+        TextureEntry& entry = m_textures[slot];
+        entry.region.texture = texture;
+        entry.region.rect = rect;
+        entry.atlasPage = atlasPage;
+        if (atlasPage >= 0) {
+            m_atlasPages[atlasPage].numTextures++;
+        }
+        LOG_DEBUG(Logger::CATEGORY_ASSETS, "Loaded texture {} ({}x{}) from {}",
+                  entry.assetId, rect.w, rect.h, entry.filePath);
+        numUploaded++;
+    };
+
+    std::vector<SDL_Point> sizes(slots.size(), SDL_Point{0, 0});
+    size_t numDecoded = 0;
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (surfaces[i]) {
+            sizes[i] = {surfaces[i]->w, surfaces[i]->h};
+            numDecoded++;
+        }
+    }
+    std::vector<AtlasPlacement> placements(slots.size(), AtlasPlacement{-1, 0, 0});
+    std::vector<SDL_Point> pageSizes;
+    // Packing a single image would only add a copy.
+    if (m_atlasPageSize > 0 && numDecoded > 1) {
+        pageSizes = PackAtlas(sizes, m_atlasPageSize, ATLAS_PADDING, placements);
+    }
+
+    // Each page is put together in memory and uploaded once.
+    for (size_t page = 0; page < pageSizes.size(); page++) {
+        SDL_Surface* pageSurface = SDL_CreateRGBSurfaceWithFormat(
+            0, pageSizes[page].x, pageSizes[page].y, 32, SDL_PIXELFORMAT_RGBA32
+        );
+        bool ok = pageSurface != nullptr;
+        for (size_t i = 0; ok && i < slots.size(); i++) {
+            if (surfaces[i] && placements[i].page == int(page)) {
+                SDL_Rect dstRect = {placements[i].x, placements[i].y, sizes[i].x, sizes[i].y};
+                // Copy the alpha channel instead of blending onto the page.
+                SDL_SetSurfaceBlendMode(surfaces[i], SDL_BLENDMODE_NONE);
+                ok = SDL_BlitSurface(surfaces[i], nullptr, pageSurface, &dstRect) == 0;
+            }
+        }
+        SDL_Texture* texture = ok ? SDL_CreateTextureFromSurface(m_renderer, pageSurface) : nullptr;
+        SDL_FreeSurface(pageSurface);
+        if (!texture) {
+            // Its images fall back to textures of their own below.
+            Logger::Err(std::string("Error creating an atlas page: ") + SDL_GetError());
+            for (AtlasPlacement& placement : placements) {
+                if (placement.page == int(page)) {
+                    placement.page = -1;
+                }
+            }
+            continue;
+        }
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+        const int atlasPage = AddAtlasPage(texture);
+        for (size_t i = 0; i < slots.size(); i++) {
+            if (surfaces[i] && placements[i].page == int(page)) {
+                finish(slots[i], texture, atlasPage, {placements[i].x, placements[i].y, sizes[i].x, sizes[i].y});
+                SDL_FreeSurface(surfaces[i]);
+                surfaces[i] = nullptr;
+            }
+        }
+    }
+
+    // Whatever is left gets a texture of its own.
+    for (size_t i = 0; i < slots.size(); i++) {
+        SDL_Surface* surface = surfaces[i];
+        if (!surface) {
+            continue;
+        }
+        SDL_Texture* texture = SDL_CreateTextureFromSurface(m_renderer, surface);
+        SDL_FreeSurface(surface);
+        surfaces[i] = nullptr;
+        if (!texture) {
+            Logger::Err("Error creating texture from " + m_textures[slots[i]].filePath + ": " + SDL_GetError());
+            Unload(slots[i]);
+            continue;
+        }
+        finish(slots[i], texture, -1, {0, 0, sizes[i].x, sizes[i].y});
+    }
+    return numUploaded;
+}
+
+int AssetStore::AddAtlasPage(SDL_Texture* texture) {
+    int index;
+    if (!m_freeAtlasPages.empty()) {
+        index = m_freeAtlasPages.back();
+        m_freeAtlasPages.pop_back();
+    } else {
+        index = int(m_atlasPages.size());
+        m_atlasPages.emplace_back();
+    }
+    m_atlasPages[index].texture = texture;
+    m_atlasPages[index].numTextures = 0;
+    return index;
+}
+
+TextureHandle AssetStore::LoadTexture(const std::string& assetId, const std::string& filePath) {
+    const TextureHandle handle = QueueTexture(assetId, filePath);
+    LoadQueued();
+    return Resolve(handle) ? handle : 0;
+}
+
+TextureHandle AssetStore::FindTexture(const std::string& assetId) const {
+    auto cached = m_handlesById.find(assetId);
+    return cached != m_handlesById.end() ? cached->second : 0;
+}
+
+void AssetStore::AcquireTexture(TextureHandle handle) {
+    const int slot = SlotOf(handle);
+    if (slot >= 0) {
+        m_textures[slot].refCount++;
+    }
+}
+
+void AssetStore::ReleaseTexture(TextureHandle handle) {
+    const int slot = SlotOf(handle);
+    if (slot < 0) {
+        return;
+    }
+    TextureEntry& entry = m_textures[slot];
+    if (entry.refCount == 0) {
+        Logger::Err("Texture " + entry.assetId + " released more times than it was loaded");
+        return;
+    }
+    entry.refCount--;
+}
+
+size_t AssetStore::UnloadUnusedTextures() {
+    size_t numUnloaded = 0;
+    for (size_t slot = 0; slot < m_textures.size(); slot++) {
+        // Queued textures are left alone until they got loaded.
+        if (m_textures[slot].region.texture && m_textures[slot].refCount == 0) {
+            Unload(uint16_t(slot));
+            numUnloaded++;
+        }
+    }
+    return numUnloaded;
+}
+
+void AssetStore::ReleaseRegion(TextureEntry& entry) {
+    if (entry.atlasPage >= 0) {
+        // The page keeps the image's pixels until its last texture goes.
+        AtlasPage& page = m_atlasPages[entry.atlasPage];
+        if (--page.numTextures == 0) {
+            SDL_DestroyTexture(page.texture);
+            page.texture = nullptr;
+            m_freeAtlasPages.push_back(entry.atlasPage);
+        }
+    } else if (entry.region.texture) {
+        SDL_DestroyTexture(entry.region.texture);
+    }
+    entry.region = TextureRegion();
+    entry.atlasPage = -1;
+}
+
+void AssetStore::Unload(uint16_t slot) {
+    TextureEntry& entry = m_textures[slot];
+    if (entry.region.texture) {
+        LOG_DEBUG(Logger::CATEGORY_ASSETS, "Unloaded texture {}", entry.assetId);
+    }
+    ReleaseRegion(entry);
+    m_handlesById.erase(entry.assetId);
+    entry.assetId.clear();
+    entry.filePath.clear();
+    entry.refCount = 0;
+    entry.used = false;
+    entry.generation++;
+    m_freeSlots.push_back(slot);
+}
+
+bool AssetStore::GetTextureSize(TextureHandle handle, int& width, int& height) const {
+    const TextureEntry* entry = Resolve(handle);
+    if (!entry) {
+        return false;
+    }
+    width = entry->region.rect.w;
+    height = entry->region.rect.h;
+    return true;
+}
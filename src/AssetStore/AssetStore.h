@@ -0,0 +1,192 @@
+#ifndef ASSET_STORE_H
+#define ASSET_STORE_H
+
+#include <SDL2/SDL.h>
+#include "AssetArchive.h"
+#include "AssetWatcher.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Identifies a texture of the AssetStore. 0 is never a valid handle.
+// The low 16 bits are the slot, the high 16 bits its generation so a
+// handle to an unloaded texture doesn't resolve to whatever reuses the
+// slot.
+using TextureHandle = uint32_t;
+
+// Where a texture's pixels are: images packed into an atlas share
+// their page's texture and each has its own rect on it.
+struct TextureRegion {
+    SDL_Texture* texture = nullptr;
+    SDL_Rect rect = {0, 0, 0, 0};
+};
+
+// What LoadQueued spent its time on.
+struct AssetLoadStats {
+    int numTextures = 0;
+    int numAtlasPages = 0;
+    int numJobs = 0;
+    int numThreads = 0;
+    double decodeMs = 0.0;
+    double uploadMs = 0.0;
+};
+
+// Owns the textures of the game. Every file is decoded and uploaded
+// once, however many times it gets loaded; components only carry the
+// handle and resolving it is an array lookup.
+//
+// Whoever calls LoadTexture or QueueTexture (a level, a scenario) holds
+// a reference until it calls ReleaseTexture. Textures nobody references
+// stay cached until UnloadUnusedTextures, so a level reloading what the
+// previous one used doesn't decode it again.
+//
+// Loading a level should queue everything it needs and call LoadQueued
+// once: the images get decoded in parallel on worker threads and then
+// turned into textures on the calling (render) thread in one pass.
+// With WatchForChanges, images rewritten on disk get reloaded in place:
+// decoded by the watcher's thread, swapped in by ApplyReloads on the
+// render thread. Handles stay valid. Tilemaps rewritten on disk get
+// loaded by the watcher's thread too, whoever draws one takes the new
+// version with TakeReloadedTilemap.
+//
+// With an archive open, assets baked into it are taken from there
+// instead of their files, already decoded.
+//
+// Images loaded together are packed into a few atlas pages, so drawing
+// them doesn't switch textures all the time. Sprites have to draw
+// through GetTextureRegion to find their image on the page.
+class AssetStore {
+    private:
+        struct TextureEntry {
+            std::string assetId;
+            std::string filePath;
+            TextureRegion region;
+            // Index into m_atlasPages, -1 if the texture is its own.
+            int atlasPage = -1;
+            int refCount = 0;
+            uint16_t generation = 1;
+            bool used = false;
+        };
+
+        struct AtlasPage {
+            SDL_Texture* texture = nullptr;
+            // Textures still on the page, it goes away with the last one.
+            int numTextures = 0;
+        };
+
+        SDL_Renderer* m_renderer;
+        // 0 gives every image a texture of its own.
+        int m_atlasPageSize;
+        std::vector<AtlasPage> m_atlasPages;
+        std::vector<int> m_freeAtlasPages;
+        std::vector<TextureEntry> m_textures;
+        std::vector<uint16_t> m_freeSlots;
+        std::unordered_map<std::string, TextureHandle> m_handlesById;
+        // Slots of queued textures waiting for LoadQueued.
+        std::vector<uint16_t> m_pendingSlots;
+        std::vector<std::function<void()>> m_pendingJobs;
+        AssetArchive m_archive;
+        // File paths under this directory are looked up in the archive.
+        std::string m_archiveRoot;
+        AssetWatcher m_watcher;
+        std::vector<AssetWatcher::Change> m_changes;
+        // The tilemaps that changed by the last ApplyReloads.
+        std::vector<AssetWatcher::Change> m_tilemapChanges;
+
+        const TextureEntry* Resolve(TextureHandle handle) const;
+        // Slot of a handle that is loaded or queued, -1 otherwise.
+        int SlotOf(TextureHandle handle) const;
+        void Unload(uint16_t slot);
+        // Destroys the texture of the entry, or its share of an atlas page.
+        void ReleaseRegion(TextureEntry& entry);
+        bool ReplaceTexture(TextureEntry& entry, SDL_Surface* surface);
+        // Creates the textures of the decoded images of slots, packing the
+        // ones that fit into atlas pages. Consumes the surfaces.
+        int UploadTextures(const std::vector<uint16_t>& slots, std::vector<SDL_Surface*>& surfaces);
+        int AddAtlasPage(SDL_Texture* texture);
+
+    public:
+        AssetStore();
+        ~AssetStore();
+
+        void Initialize(SDL_Renderer* renderer);
+        // Loads assets whose path is in rootDir from the archive at path
+        // from now on, when it has them.
+        bool OpenArchive(const std::string& path, const std::string& rootDir);
+        // The archive's entry for the file at filePath, nullptr if there is
+        // none or no archive is open.
+        const ArchiveEntry* FindArchived(const std::string& filePath) const;
+        const uint8_t* GetArchivedData(const ArchiveEntry& entry) const { return m_archive.GetData(entry); }
+
+        // Starts reloading the images under rootDir when they change.
+        bool WatchForChanges(const std::string& rootDir);
+        // Swaps in the images that changed since the last call, returns
+        // how many textures were replaced. Call it once a frame.
+        int ApplyReloads();
+        // The tilemap at filePath if it changed by the last ApplyReloads,
+        // nullptr otherwise. Ones nobody takes are dropped by the next
+        // ApplyReloads.
+        std::unique_ptr<Tilemap> TakeReloadedTilemap(const std::string& filePath);
+
+        // Side of the atlas pages created from now on, clamped to what the
+        // renderer supports. 0 turns packing off.
+        void SetAtlasPageSize(int size);
+        // Unloads everything, handles held anywhere become invalid.
+        void Clear();
+
+        // Returns the handle of assetId and takes a reference. New assets
+        // are only read by the next LoadQueued, until then (and for good
+        // if the file can't be read) GetTexture returns nullptr.
+        TextureHandle QueueTexture(const std::string& assetId, const std::string& filePath);
+        // Runs job on a worker thread during the next LoadQueued, for
+        // other CPU bound loading like parsing tilemaps.
+        void QueueJob(std::function<void()> job);
+        // Decodes the queued images and runs the queued jobs on worker
+        // threads, then creates the textures on the calling thread.
+        AssetLoadStats LoadQueued();
+        // QueueTexture and LoadQueued for a single texture. 0 if the file
+        // can't be read.
+        TextureHandle LoadTexture(const std::string& assetId, const std::string& filePath);
+
+        // Handle of an already loaded texture without taking a reference,
+        // 0 if there is none.
+        TextureHandle FindTexture(const std::string& assetId) const;
+        void AcquireTexture(TextureHandle handle);
+        void ReleaseTexture(TextureHandle handle);
+        // Destroys the textures no one holds a reference to anymore.
+        size_t UnloadUnusedTextures();
+
+        // nullptr for invalid, stale or not yet loaded handles.
+        const TextureRegion* GetTextureRegion(TextureHandle handle) const {
+            const TextureEntry* entry = Resolve(handle);
+            return entry ? &entry->region : nullptr;
+        }
+        // The whole texture the handle is on, which is the atlas page for
+        // packed images.
+        SDL_Texture* GetTexture(TextureHandle handle) const {
+            const TextureEntry* entry = Resolve(handle);
+            return entry ? entry->region.texture : nullptr;
+        }
+        bool GetTextureSize(TextureHandle handle, int& width, int& height) const;
+        size_t GetNumTextures() const { return m_handlesById.size(); }
+        size_t GetNumAtlasPages() const { return m_atlasPages.size() - m_freeAtlasPages.size(); }
+};
+
+inline int AssetStore::SlotOf(TextureHandle handle) const {
+    const uint32_t slot = (handle & 0xffff) - 1;
+    if (slot >= m_textures.size()) {
+        return -1;
+    }
+    const TextureEntry& entry = m_textures[slot];
+    return entry.used && entry.generation == (handle >> 16) ? int(slot) : -1;
+}
+
+inline const AssetStore::TextureEntry* AssetStore::Resolve(TextureHandle handle) const {
+    const int slot = SlotOf(handle);
+    return slot >= 0 && m_textures[slot].region.texture ? &m_textures[slot] : nullptr;
+}
+
+#endif
@@ -0,0 +1,159 @@
+#include "AssetWatcher.h"
+#include "../Logger/Logger.h"
+#include "../Profiler/Profiler.h"
+#include <SDL2/SDL_image.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#define ASSET_WATCHER_INOTIFY
+#endif
+
+// Editors write a file in several goes, or save it twice in a row. Wait
+// this long after the last event before reading anything.
+static const int SETTLE_MS = 100;
+
+static bool HasExtension(const std::string& path, const char* extension) {
+    const size_t length = strlen(extension);
+    return path.size() >= length && path.compare(path.size() - length, length, extension) == 0;
+}
+
+AssetWatcher::AssetWatcher() : m_inotify(-1), m_stop(false) {
+}
+
+AssetWatcher::~AssetWatcher() {
+    Stop();
+}
+
+bool AssetWatcher::Start(const std::string& rootDir) {
+#ifdef ASSET_WATCHER_INOTIFY
+    Stop();
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify < 0) {
+        Logger::Err("Could not start watching " + rootDir + " for changes");
+        return false;
+    }
+    std::string root = rootDir;
+    if (root.empty() || root.back() != '/') {
+        root += '/';
+    }
+    WatchDirectory(root);
+    std::error_code error;
+    for (auto it = std::filesystem::recursive_directory_iterator(root, error);
+         it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+        if (it->is_directory()) {
+            WatchDirectory(it->path().generic_string() + "/");
+        }
+    }
+    m_stop = false;
+    m_thread = std::thread(&AssetWatcher::Run, this);
+    Logger::Log("Watching " + root + " for changed assets");
+    return true;
+#else
+    Logger::Log("Hot reloading assets needs inotify, which this platform doesn't have");
+    return false;
+#endif
+}
+
+void AssetWatcher::Stop() {
+    if (m_thread.joinable()) {
+        m_stop = true;
+        m_thread.join();
+    }
+#ifdef ASSET_WATCHER_INOTIFY
+    if (m_inotify >= 0) {
+        close(m_inotify);
+        m_inotify = -1;
+    }
+#endif
+    m_directories.clear();
+    std::lock_guard<std::mutex> lock(m_changesMutex);
+    for (Change& change : m_changes) {
+        SDL_FreeSurface(change.surface);
+    }
+    m_changes.clear();
+}
+
+void AssetWatcher::TakeChanges(std::vector<Change>& out) {
+    std::lock_guard<std::mutex> lock(m_changesMutex);
+    std::move(m_changes.begin(), m_changes.end(), std::back_inserter(out));
+    m_changes.clear();
+}
+
+void AssetWatcher::WatchDirectory(const std::string& directory) {
+#ifdef ASSET_WATCHER_INOTIFY
+    // Saving over a file ends in IN_CLOSE_WRITE, saving to a temporary
+    // file and renaming it in IN_MOVED_TO.
+    const int descriptor = inotify_add_watch(m_inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if (descriptor >= 0) {
+        m_directories[descriptor] = directory;
+    }
+#endif
+}
+
+void AssetWatcher::Run() {
+#ifdef ASSET_WATCHER_INOTIFY
+    std::vector<std::string> changed;
+    alignas(inotify_event) char buffer[4096];
+    auto lastEvent = std::chrono::steady_clock::now();
+    while (!m_stop) {
+        pollfd descriptor = {m_inotify, POLLIN, 0};
+        if (poll(&descriptor, 1, SETTLE_MS) > 0) {
+            ssize_t length;
+            while ((length = read(m_inotify, buffer, sizeof(buffer))) > 0) {
+                for (char* cursor = buffer; cursor < buffer + length; ) {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>(cursor);
+                    cursor += sizeof(inotify_event) + event->len;
+                    auto directory = m_directories.find(event->wd);
+                    if (event->len == 0 || directory == m_directories.end()) {
+                        continue;
+                    }
+                    const std::string path = directory->second + event->name;
+                    if (event->mask & IN_ISDIR) {
+                        if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                            WatchDirectory(path + "/");
+                        }
+                    } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                        changed.push_back(path);
+                    }
+                }
+            }
+            lastEvent = std::chrono::steady_clock::now();
+            continue;
+        }
+        if (changed.empty() || std::chrono::steady_clock::now() - lastEvent < std::chrono::milliseconds(SETTLE_MS)) {
+            continue;
+        }
+
+        std::sort(changed.begin(), changed.end());
+        changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+        for (const std::string& path : changed) {
+            Change change;
+            change.filePath = path;
+            if (HasExtension(path, ".png")) {
+                PROFILE_SCOPE("AssetWatcher::DecodeImage");
+                change.surface = IMG_Load(path.c_str());
+                if (!change.surface) {
+                    change.error = IMG_GetError();
+                }
+            } else if (HasExtension(path, ".map") || HasExtension(path, ".tmb")) {
+                PROFILE_SCOPE("AssetWatcher::LoadTilemap");
+                change.tilemap = std::make_unique<Tilemap>();
+                if (!change.tilemap->Load(path)) {
+                    change.tilemap.reset();
+                    change.error = "not a valid tilemap";
+                }
+            } else {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(m_changesMutex);
+            m_changes.push_back(std::move(change));
+        }
+        changed.clear();
+    }
+#endif
+}
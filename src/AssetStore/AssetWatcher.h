@@ -0,0 +1,60 @@
+#ifndef ASSET_WATCHER_H
+#define ASSET_WATCHER_H
+
+#include <SDL2/SDL.h>
+#include "Tilemap.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Watches a directory tree for files being written and decodes the
+// changed images and tilemaps on a thread of its own, so the main thread
+// only has to swap the result in. Needs inotify, on other platforms Start fails and
+// nothing gets reloaded.
+class AssetWatcher {
+    public:
+        struct Change {
+            // rootDir followed by the path inside it, the way the file was
+            // loaded, for example "./assets/images/tree.png".
+            std::string filePath;
+            // The image, nullptr for tilemaps or if decoding failed. The
+            // receiver frees it.
+            SDL_Surface* surface = nullptr;
+            // The tilemap (.map or .tmb), nullptr for images or if it
+            // couldn't be loaded.
+            std::unique_ptr<Tilemap> tilemap;
+            // Why neither could be loaded, empty if one was.
+            std::string error;
+        };
+
+    private:
+        int m_inotify;
+        // Watch descriptor to the directory it watches, with a trailing
+        // slash.
+        std::unordered_map<int, std::string> m_directories;
+        std::thread m_thread;
+        std::atomic<bool> m_stop;
+        std::mutex m_changesMutex;
+        std::vector<Change> m_changes;
+
+        void WatchDirectory(const std::string& directory);
+        void Run();
+
+    public:
+        AssetWatcher();
+        ~AssetWatcher();
+
+        bool Start(const std::string& rootDir);
+        // Frees the changes that weren't taken yet.
+        void Stop();
+        bool IsRunning() const { return m_thread.joinable(); }
+
+        // Moves the changes decoded since the last call into out.
+        void TakeChanges(std::vector<Change>& out);
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "MappedFile.h"
+#include <cstdio>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPED_FILE_MMAP
+#endif
+
+MappedFile::MappedFile() : m_data(nullptr), m_size(0) {
+}
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Open(const std::string& path) {
+    Close();
+#ifdef MAPPED_FILE_MMAP
+    const int fileDescriptor = open(path.c_str(), O_RDONLY);
+    if (fileDescriptor < 0) {
+        return false;
+    }
+    struct stat status;
+    void* address = MAP_FAILED;
+    if (fstat(fileDescriptor, &status) == 0 && status.st_size > 0) {
+        address = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    }
+    // The mapping keeps the file alive.
+    close(fileDescriptor);
+    if (address == MAP_FAILED) {
+        return false;
+    }
+    m_data = static_cast<const uint8_t*>(address);
+    m_size = uint64_t(status.st_size);
+#else
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    m_buffer.resize(size_t(ftell(file)));
+    fseek(file, 0, SEEK_SET);
+    const bool ok = fread(m_buffer.data(), 1, m_buffer.size(), file) == m_buffer.size();
+    fclose(file);
+    if (!ok || m_buffer.empty()) {
+        m_buffer.clear();
+        return false;
+    }
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+#endif
+    return true;
+}
+
+void MappedFile::Close() {
+#ifdef MAPPED_FILE_MMAP
+    if (m_data) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+#endif
+    m_buffer.clear();
+    m_data = nullptr;
+    m_size = 0;
+}
@@ -0,0 +1,33 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A whole file mapped read-only into memory. Pages are only read in when
+// they are touched. Platforms without mmap get the file read into a
+// buffer instead.
+class MappedFile {
+    private:
+        const uint8_t* m_data;
+        uint64_t m_size;
+        std::vector<uint8_t> m_buffer;
+
+    public:
+        MappedFile();
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // Fails for missing and empty files.
+        bool Open(const std::string& path);
+        // Pointers into the file become invalid.
+        void Close();
+        bool IsOpen() const { return m_data != nullptr; }
+
+        const uint8_t* GetData() const { return m_data; }
+        uint64_t GetSize() const { return m_size; }
+};
+
+#endif
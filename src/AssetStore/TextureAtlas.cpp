@@ -0,0 +1,60 @@
+#include "TextureAtlas.h"
+#include <algorithm>
+
+// Dear ImGui compiles its copy of stb_rect_pack with STBRP_STATIC, so
+// this one doesn't clash with it.
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#include <imgui/imstb_rectpack.h>
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+std::vector<SDL_Point> PackAtlas(
+    const std::vector<SDL_Point>& sizes,
+    int pageSize,
+    int padding,
+    std::vector<AtlasPlacement>& placements
+) {
+    placements.assign(sizes.size(), {-1, 0, 0});
+    std::vector<stbrp_rect> pending;
+    for (size_t i = 0; i < sizes.size(); i++) {
+        const int width = sizes[i].x + padding;
+        const int height = sizes[i].y + padding;
+        if (width <= pageSize && height <= pageSize) {
+            stbrp_rect rect = {};
+            rect.id = int(i);
+            rect.w = width;
+            rect.h = height;
+            pending.push_back(rect);
+        }
+    }
+
+    // Fill one page after the other with what didn't fit on the previous
+    // ones. Everything left fits on an empty page, so this terminates.
+    std::vector<SDL_Point> pages;
+    std::vector<stbrp_node> nodes(pageSize);
+    while (!pending.empty()) {
+        stbrp_context context;
+        stbrp_init_target(&context, pageSize, pageSize, nodes.data(), int(nodes.size()));
+        stbrp_pack_rects(&context, pending.data(), int(pending.size()));
+
+        SDL_Point used = {0, 0};
+        const int page = int(pages.size());
+        auto packed = std::stable_partition(pending.begin(), pending.end(), [](const stbrp_rect& rect) {
+            return !rect.was_packed;
+        });
+        for (auto rect = packed; rect != pending.end(); ++rect) {
+            placements[rect->id] = {page, rect->x, rect->y};
+            used.x = std::max(used.x, rect->x + rect->w);
+            used.y = std::max(used.y, rect->y + rect->h);
+        }
+        pending.erase(packed, pending.end());
+        pages.push_back(used);
+    }
+    return pages;
+}
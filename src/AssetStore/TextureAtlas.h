@@ -0,0 +1,26 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+
+// Where PackAtlas put an image: the page and the top left corner on it.
+// page is -1 for images too big for a page.
+struct AtlasPlacement {
+    int page;
+    int x;
+    int y;
+};
+
+// Packs images of the given sizes onto as few pages of pageSize x
+// pageSize as it can, leaving padding pixels between them so filtering
+// doesn't bleed neighbours in. Returns how much of each page is used,
+// which is what the page textures need to be.
+std::vector<SDL_Point> PackAtlas(
+    const std::vector<SDL_Point>& sizes,
+    int pageSize,
+    int padding,
+    std::vector<AtlasPlacement>& placements
+);
+
+#endif
@@ -0,0 +1,156 @@
+#include "Tilemap.h"
+#include "../Logger/Logger.h"
+#include "../Profiler/Profiler.h"
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+Tilemap::Tilemap() : m_numCols(0), m_numRows(0), m_tiles(nullptr) {
+}
+
+void Tilemap::Clear() {
+    m_numCols = 0;
+    m_numRows = 0;
+    m_storage.clear();
+    m_file.Close();
+    m_tiles = nullptr;
+}
+
+bool Tilemap::Load(const std::string& path) {
+    const size_t length = path.size();
+    if (length >= 4 && path.compare(length - 4, 4, ".tmb") == 0) {
+        return LoadBinary(path);
+    }
+    return LoadCsv(path);
+}
+
+bool Tilemap::LoadCsv(const std::string& path) {
+    PROFILE_SCOPE("Tilemap::LoadCsv");
+    Clear();
+    MappedFile file;
+    if (!file.Open(path)) {
+        Logger::Err("Could not open the tilemap " + path);
+        return false;
+    }
+    return ParseCsv(reinterpret_cast<const char*>(file.GetData()), size_t(file.GetSize()), path);
+}
+
+bool Tilemap::ParseCsv(const char* text, size_t length, const std::string& name) {
+    Clear();
+    // Tile ids are at least two characters apart, which bounds how many
+    // there can be.
+    m_storage.reserve(length / 2 + 1);
+    const char* cursor = text;
+    const char* end = text + length;
+    size_t rowStart = 0;
+    int numCols = 0;
+    int numRows = 0;
+    while (cursor < end) {
+        // Skip blank lines and the '\r' of CRLF line endings.
+        if (*cursor == '\n' || *cursor == '\r') {
+            cursor++;
+            continue;
+        }
+        uint16_t tile;
+        const auto [next, error] = std::from_chars(cursor, end, tile);
+        if (error != std::errc()) {
+            Logger::Err(name + ": tile " + std::to_string(m_storage.size() - rowStart + 1) + " on row " +
+                        std::to_string(numRows + 1) + " is not a tile id");
+            Clear();
+            return false;
+        }
+        m_storage.push_back(tile);
+        cursor = next;
+        // The line ends the row, with or without a trailing comma.
+        const bool comma = cursor < end && *cursor == ',';
+        if (comma) {
+            cursor++;
+        }
+        if (cursor < end && *cursor != '\n' && *cursor != '\r') {
+            if (comma) {
+                continue;
+            }
+            Logger::Err(name + ": unexpected '" + std::string(1, *cursor) + "' on row " + std::to_string(numRows + 1));
+            Clear();
+            return false;
+        }
+
+        // End of the row, which has to be as wide as the first.
+        const int rowCols = int(m_storage.size() - rowStart);
+        if (numRows == 0) {
+            numCols = rowCols;
+        } else if (rowCols != numCols) {
+            Logger::Err(name + ": row " + std::to_string(numRows + 1) + " has " + std::to_string(rowCols) +
+                        " tiles instead of " + std::to_string(numCols));
+            Clear();
+            return false;
+        }
+        numRows++;
+        rowStart = m_storage.size();
+    }
+    if (numRows == 0) {
+        Logger::Err(name + " has no tiles");
+        return false;
+    }
+    m_storage.shrink_to_fit();
+    m_numCols = numCols;
+    m_numRows = numRows;
+    m_tiles = m_storage.data();
+    return true;
+}
+
+bool Tilemap::LoadBinary(const std::string& path) {
+    PROFILE_SCOPE("Tilemap::LoadBinary");
+    Clear();
+    if (!m_file.Open(path)) {
+        Logger::Err("Could not open the tilemap " + path);
+        return false;
+    }
+    TilemapFileHeader header;
+    bool ok = m_file.GetSize() >= sizeof(header);
+    if (ok) {
+        memcpy(&header, m_file.GetData(), sizeof(header));
+        ok = memcmp(header.magic, TILEMAP_MAGIC, sizeof(TILEMAP_MAGIC)) == 0 &&
+            header.version == TILEMAP_VERSION &&
+            header.numCols > 0 && header.numCols <= 0xffff &&
+            header.numRows > 0 && header.numRows <= 0xffff &&
+            m_file.GetSize() == sizeof(header) + uint64_t(header.numCols) * header.numRows * sizeof(uint16_t);
+    }
+    if (!ok) {
+        Logger::Err(path + " is not a tilemap of this version");
+        Clear();
+        return false;
+    }
+    m_numCols = int(header.numCols);
+    m_numRows = int(header.numRows);
+    m_tiles = reinterpret_cast<const uint16_t*>(m_file.GetData() + sizeof(header));
+    return true;
+}
+
+void Tilemap::SetView(int numCols, int numRows, const uint16_t* tiles) {
+    Clear();
+    m_numCols = numCols;
+    m_numRows = numRows;
+    m_tiles = tiles;
+}
+
+bool Tilemap::Save(const std::string& path) const {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        Logger::Err("Could not create " + path);
+        return false;
+    }
+    TilemapFileHeader header = {};
+    memcpy(header.magic, TILEMAP_MAGIC, sizeof(TILEMAP_MAGIC));
+    header.version = TILEMAP_VERSION;
+    header.numCols = uint32_t(m_numCols);
+    header.numRows = uint32_t(m_numRows);
+    const size_t numTiles = size_t(m_numCols) * m_numRows;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(m_tiles, sizeof(uint16_t), numTiles, file) == numTiles;
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        Logger::Err("Error writing " + path);
+    }
+    return ok;
+}
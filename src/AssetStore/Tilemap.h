@@ -0,0 +1,61 @@
+#ifndef TILEMAP_H
+#define TILEMAP_H
+
+#include "MappedFile.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A grid of tile ids, each the index of a tile in the tileset image
+// (jungle.png for jungle.map), stored row by row.
+//
+// Maps come either as CSV text (.map), one row per line, or in the
+// binary .tmb format: a TilemapFileHeader followed by the numCols x
+// numRows uint16_t tile ids in the host's byte order. A .tmb file is
+// mapped into memory and used in place, loading it doesn't read or
+// parse anything. Save writes one.
+static const char TILEMAP_MAGIC[8] = {'2', 'D', 'G', 'E', 'T', 'M', 'A', 'P'};
+static const uint32_t TILEMAP_VERSION = 1;
+
+struct TilemapFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t numCols;
+    uint32_t numRows;
+    uint32_t reserved;
+};
+
+class Tilemap {
+    private:
+        int m_numCols;
+        int m_numRows;
+        // m_tiles points into one of these, or into memory the caller
+        // owns (SetView).
+        std::vector<uint16_t> m_storage;
+        MappedFile m_file;
+        const uint16_t* m_tiles;
+
+    public:
+        Tilemap();
+        Tilemap(const Tilemap&) = delete;
+        Tilemap& operator=(const Tilemap&) = delete;
+
+        // Picks the format by the extension, CSV unless it's .tmb.
+        bool Load(const std::string& path);
+        bool LoadCsv(const std::string& path);
+        bool LoadBinary(const std::string& path);
+        // Parses CSV text, name is only used in error messages.
+        bool ParseCsv(const char* text, size_t length, const std::string& name);
+        // Uses tiles, which has to outlive the tilemap or the next load,
+        // without copying them (a tilemap from the asset archive).
+        void SetView(int numCols, int numRows, const uint16_t* tiles);
+        bool Save(const std::string& path) const;
+        void Clear();
+
+        int GetNumCols() const { return m_numCols; }
+        int GetNumRows() const { return m_numRows; }
+        const uint16_t* GetTiles() const { return m_tiles; }
+        uint16_t GetTile(int col, int row) const { return m_tiles[size_t(row) * m_numCols + col]; }
+};
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef SPRITE_COMPONENT_H
+#define SPRITE_COMPONENT_H
+
+#include <SDL2/SDL.h>
+#include "../AssetStore/AssetStore.h"
+
+struct SpriteComponent
+{
+    TextureHandle texture;
+    int width;
+    int height;
+    // Sprites with a higher z-index are drawn on top.
+    int zIndex;
+    SDL_RendererFlip flip;
+    // Part of the texture that gets drawn, for sprite sheets.
+    SDL_Rect srcRect;
+
+    SpriteComponent(TextureHandle texture = 0, int width = 0, int height = 0, int zIndex = 0, int srcRectX = 0, int srcRectY = 0)
+    {
+        this->texture = texture;
+        this->width = width;
+        this->height = height;
+        this->zIndex = zIndex;
+        this->flip = SDL_FLIP_NONE;
+        this->srcRect = {srcRectX, srcRectY, width, height};
+    }
+};
+
+#endif
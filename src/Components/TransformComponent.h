@@ -9,11 +9,18 @@ struct TransformComponent
     glm::vec2 scale;
     double rotation;
 
+    // State at the end of the previous simulation step, the renderer
+    // interpolates between it and the current one.
+    glm::vec2 previousPosition;
+    double previousRotation;
+
     TransformComponent(glm::vec2 position = glm::vec2(0, 0), glm::vec2 scale = glm::vec2(1, 1), double rotation = 0)
     {
         this->position = position;
         this->scale = scale;
         this->rotation = rotation;
+        this->previousPosition = position;
+        this->previousRotation = rotation;
     }
 };
 
@@ -3,14 +3,27 @@
 
 int BaseComponent::_nextId = 0;
 
-int Entity::GetId() const
+const Signature &System::GetSignature() const
 {
-    return _id;
+    return _componentSignature;
 }
 
-const Signature &System::GetSignature() const
+const Signature &System::GetExcludedSignature() const
 {
-    return _componentSignature;
+    return _excludedSignature;
+}
+
+const Signature &System::GetOptionalSignature() const
+{
+    return _optionalSignature;
+}
+
+bool System::IsInterestedIn(const Signature &entitySignature) const
+{
+    // Keep only the bits the system cares about (required and excluded ones).
+    // What remains has to be exactly the required bits: every required
+    // component is there and none of the excluded ones is.
+    return (entitySignature & _filterMask) == _componentSignature;
 }
 
 void System::AddEntity(Entity e)
@@ -27,38 +40,170 @@ void System::RemoveEntity(Entity e)
         _entities.end());
 }
 
-std::vector<Entity> System::GetEntities() const
+void System::RemoveEntities(const std::vector<bool> &isRemoved)
+{
+    _entities.erase(
+        std::remove_if(_entities.begin(), _entities.end(),
+                       [&isRemoved](auto other)
+                       { return isRemoved[other.GetId()]; }),
+        _entities.end());
+}
+
+const std::vector<Entity> &System::GetEntities() const
 {
     return _entities;
 }
 
 void Registry::Update()
 {
-    // TODO
     // Add entities waiting to be added
+    for (auto entity : _entitiesToBeAdded)
+    {
+        AddEntityToSystem(entity);
+    }
+    _entitiesToBeAdded.clear();
+
+    UpdateSystemMembership();
+
     // Remove entities waiting to be killed
+    if (_entitiesToBeKilled.empty())
+    {
+        return;
+    }
+
+    // Handles of entities that are already dead (killed twice, or stale
+    // handles to an id that was reused since) are dropped here.
+    for (auto it = _entitiesToBeKilled.begin(); it != _entitiesToBeKilled.end();)
+    {
+        it = IsAlive(*it) ? std::next(it) : _entitiesToBeKilled.erase(it);
+    }
+
+    // Flag them all first so each system is filtered in a single pass
+    // instead of searching its entity list once per killed entity.
+    _isKilled.assign(_numEntities, false);
+    for (auto entity : _entitiesToBeKilled)
+    {
+        _isKilled[entity.GetId()] = true;
+    }
+    for (auto &system : _systems)
+    {
+        system.second->RemoveEntities(_isKilled);
+    }
+
+    for (auto entity : _entitiesToBeKilled)
+    {
+        const int entityId = entity.GetId();
+        const auto &signature = _entityComponentSignature[entityId];
+        for (size_t componentId = 0; componentId < _componentPools.size(); componentId++)
+        {
+            if (signature.test(componentId) && _componentPools[componentId])
+            {
+                _componentPools[componentId]->RemoveEntityFromPool(entityId);
+            }
+        }
+        _entityComponentSignature[entityId].reset();
+        _systemSignature[entityId].reset();
+        _entityGenerations[entityId]++;
+        _freeIds.push_back(entityId);
+    }
+    _entitiesToBeKilled.clear();
 }
 
 Entity Registry::CreateEntity()
 {
-    int entityId = _numEntities++;
-    if (entityId >= _entityComponentSignature.size())
+    int entityId;
+    if (_freeIds.empty())
+    {
+        entityId = _numEntities++;
+        if (entityId >= (int)_entityComponentSignature.size())
+        {
+            _entityComponentSignature.resize(entityId + 1);
+            _systemSignature.resize(entityId + 1);
+            _entityGenerations.resize(entityId + 1, 0);
+        }
+    }
+    else
     {
-        _entityComponentSignature.resize(entityId + 1);
+        // Reuse the id of an entity that was killed before.
+        entityId = _freeIds.front();
+        _freeIds.pop_front();
     }
-    Entity entity(entityId);
+    Entity entity(entityId, _entityGenerations[entityId]);
     _entitiesToBeAdded.insert(entity);
 
-    Logger::Log("Entity created with id = " + std::to_string(entityId));
+    LOG_TRACE(Logger::CATEGORY_ECS, "Entity created with id = {}", entityId);
 
     return entity;
 }
 
-void Registry::KillEntity()
+void Registry::KillEntity(Entity e)
+{
+    _entitiesToBeKilled.insert(e);
+    LOG_TRACE(Logger::CATEGORY_ECS, "Entity killed with id = {}", e.GetId());
+}
+
+void Registry::CreateEntities(size_t count, std::vector<Entity> &out)
 {
+    out.reserve(out.size() + count);
+    const size_t numReused = std::min(count, _freeIds.size());
+    for (size_t i = 0; i < numReused; i++)
+    {
+        out.emplace_back(_freeIds.front(), _entityGenerations[_freeIds.front()]);
+        _freeIds.pop_front();
+        _entitiesToBeAdded.insert(out.back());
+    }
 
-    Logger::Log("Entity killed...");
-    _numEntities--;
+    // The rest get new ids, all larger than any id in the set so far.
+    const int firstId = _numEntities;
+    _numEntities += (int)(count - numReused);
+    if (_numEntities > (int)_entityComponentSignature.size())
+    {
+        _entityComponentSignature.resize(_numEntities);
+        _systemSignature.resize(_numEntities);
+        _entityGenerations.resize(_numEntities, 0);
+    }
+    for (int entityId = firstId; entityId < _numEntities; entityId++)
+    {
+        out.emplace_back(entityId);
+        _entitiesToBeAdded.insert(_entitiesToBeAdded.end(), out.back());
+    }
+
+    LOG_TRACE(Logger::CATEGORY_ECS, "Created {} entities", count);
+}
+
+void Registry::KillEntities(const std::vector<Entity> &entities)
+{
+    _entitiesToBeKilled.insert(entities.begin(), entities.end());
+    LOG_TRACE(Logger::CATEGORY_ECS, "Killed {} entities", entities.size());
+}
+
+bool Registry::IsAlive(Entity e) const
+{
+    const int entityId = e.GetId();
+    return entityId >= 0 && entityId < _numEntities && _entityGenerations[entityId] == e.GetGeneration();
+}
+
+Entity Registry::GetEntity(int entityId) const
+{
+    return Entity(entityId, _entityGenerations[entityId]);
+}
+
+size_t Registry::GetNumAliveEntities() const
+{
+    return _numEntities - _freeIds.size();
+}
+
+std::vector<PoolStats> Registry::GetPoolStats() const
+{
+    std::vector<PoolStats> stats;
+    for (const auto &pool : _componentPools)
+    {
+        if (pool)
+        {
+            stats.push_back({pool->GetComponentName(), pool->GetSize(), pool->GetMemoryUsage()});
+        }
+    }
+    return stats;
 }
 
 void Registry::AddEntityToSystem(Entity e)
@@ -69,18 +214,74 @@ void Registry::AddEntityToSystem(Entity e)
     for (auto &system : _systems)
     {
         // If the entity signature matches with
-        // the system signature then the entity should
+        // the system signature (required components present and
+        // excluded components absent) then the entity should
         // be added to the system.
-        const auto& systemComponentSignature = system.second->GetSignature();
-        // Bitwise AND of both signatures and if the remaining
-        // set bits are the same as those of the system signature
-        // then this entity should be 'affected' by this system.
-        bool isInterested = (entityComponentSignature & systemComponentSignature) == systemComponentSignature;
+        bool isInterested = system.second->IsInterestedIn(entityComponentSignature);
         if (isInterested) {
             // Add entity to system.
             system.second->AddEntity(e);
         }
         
     }
+    _systemSignature[e.GetId()] = entityComponentSignature;
+}
+
+void Registry::UpdateSystemMembership()
+{
+    // Entities that only got components since they were created (and
+    // were just added to their systems) have nothing to change, drop them
+    // along with the dead ones.
+    size_t numChanged = 0;
+    for (auto entity : _entitiesChanged)
+    {
+        const int entityId = entity.GetId();
+        _isChanged[entityId] = false;
+        if (IsAlive(entity) && _systemSignature[entityId] != _entityComponentSignature[entityId])
+        {
+            _entitiesChanged[numChanged++] = entity;
+        }
+    }
+    _entitiesChanged.resize(numChanged, Entity(-1));
+    if (_entitiesChanged.empty())
+    {
+        return;
+    }
 
-}
\ No newline at end of file
+    // An entity leaves the systems it matched before and no longer does,
+    // and joins the ones it didn't match before and does now. Leaving is
+    // flagged and done in one pass per system, like killing.
+    _isKilled.assign(_numEntities, false);
+    for (auto &system : _systems)
+    {
+        bool anyLeft = false;
+        for (auto entity : _entitiesChanged)
+        {
+            const int entityId = entity.GetId();
+            const bool wasInterested = system.second->IsInterestedIn(_systemSignature[entityId]);
+            const bool isInterested = system.second->IsInterestedIn(_entityComponentSignature[entityId]);
+            if (isInterested && !wasInterested)
+            {
+                system.second->AddEntity(entity);
+            }
+            else if (wasInterested && !isInterested)
+            {
+                _isKilled[entityId] = true;
+                anyLeft = true;
+            }
+        }
+        if (anyLeft)
+        {
+            system.second->RemoveEntities(_isKilled);
+            for (auto entity : _entitiesChanged)
+            {
+                _isKilled[entity.GetId()] = false;
+            }
+        }
+    }
+    for (auto entity : _entitiesChanged)
+    {
+        _systemSignature[entity.GetId()] = _entityComponentSignature[entity.GetId()];
+    }
+    _entitiesChanged.clear();
+}
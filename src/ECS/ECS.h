@@ -2,31 +2,41 @@
 #define ECS_H
 
 #include <bitset>
+#include <cstdint>
 #include <vector>
 #include <array>
+#include <memory>
+#include <algorithm>
 #include <unordered_map>
 #include <typeindex>
+#include <typeinfo>
 #include <set>
+#include <deque>
 
 const unsigned int MAX_COMPONENTS = 32;
 using Signature = std::bitset<MAX_COMPONENTS>;
 
+// Ids get reused once their entity is killed. The generation tells the
+// entities that had the same id apart, so killing a stale handle (or the
+// same entity twice) doesn't kill whoever has the id now.
 class Entity
 {
 private:
     int _id;
+    uint32_t _generation;
 
 public:
-    Entity(int id) : _id(id) {};
-    int GetId() const;
+    Entity(int id, uint32_t generation = 0) : _id(id), _generation(generation) {};
+    int GetId() const { return _id; }
+    uint32_t GetGeneration() const { return _generation; }
     bool operator==(const Entity &other) const
     {
-        return _id == other._id;
+        return _id == other._id && _generation == other._generation;
     }
 
     bool operator<(const Entity &other) const
     {
-        return _id < other._id;
+        return _id < other._id || (_id == other._id && _generation < other._generation);
     }
 };
 
@@ -39,72 +49,381 @@ protected:
 template <typename T>
 class Component : public BaseComponent
 {
+public:
     static int GetId()
     {
-        static auto id = _nextId;
-        _nextId += 1;
+        // Only the first call for each T hands out a new id.
+        static auto id = _nextId++;
         return id;
     }
 };
 
+// Filters that can be passed to System::RequireComponent instead of a
+// plain component type.
+//
+// RequireComponent<Without<T>>() keeps entities that have T out of the system.
+// RequireComponent<Optional<T>>() does not affect membership, it only records
+// that the system may read T when the entity happens to have it.
+template <typename TComponent>
+struct Without
+{
+};
+
+template <typename TComponent>
+struct Optional
+{
+};
+
+template <typename T>
+class Pool;
+
+template <typename T>
+class PoolSnapshot;
+
 class System
 {
 private:
+    // Components an entity must have.
     Signature _componentSignature;
+    // Components an entity must NOT have.
+    Signature _excludedSignature;
+    // Components the system reads if present.
+    Signature _optionalSignature;
+    // Every bit that takes part in the membership test (required | excluded),
+    // kept up to date so the test is a single AND + compare.
+    Signature _filterMask;
     std::vector<Entity> _entities;
+    // Scratch buffer for SortEntities.
+    std::vector<Entity> _sortSlots;
 
 public:
     System() = default;
-    ~System() = default;
+    virtual ~System() = default;
 
     const Signature &GetSignature() const;
+    const Signature &GetExcludedSignature() const;
+    const Signature &GetOptionalSignature() const;
+    bool IsInterestedIn(const Signature &entitySignature) const;
     void AddEntity(Entity e);
     void RemoveEntity(Entity e);
-    std::vector<Entity> GetEntities() const;
+    // Removes in a single pass every entity whose id is flagged in isRemoved.
+    void RemoveEntities(const std::vector<bool> &isRemoved);
+    const std::vector<Entity> &GetEntities() const;
+
+    // Reorders the entities of the system so that iterating them walks the
+    // given pool front to back.
+    template <typename TComponent>
+    void SortEntities(const Pool<TComponent> &pool);
 
     template <typename TComponent>
     void RequireComponent();
 };
 
+// Maps each kind of filter to the signature it has to be recorded in.
+template <typename TComponent>
+struct SignatureFilter
+{
+    static void Apply(Signature &required, Signature &excluded, Signature &optional)
+    {
+        required.set(Component<TComponent>::GetId());
+    }
+};
+
+template <typename TComponent>
+struct SignatureFilter<Without<TComponent>>
+{
+    static void Apply(Signature &required, Signature &excluded, Signature &optional)
+    {
+        excluded.set(Component<TComponent>::GetId());
+    }
+};
+
+template <typename TComponent>
+struct SignatureFilter<Optional<TComponent>>
+{
+    static void Apply(Signature &required, Signature &excluded, Signature &optional)
+    {
+        optional.set(Component<TComponent>::GetId());
+    }
+};
+
 class BasePool
 {
 public:
     virtual ~BasePool() {}
+    virtual void RemoveEntityFromPool(int entityId) = 0;
+    virtual size_t GetSize() const = 0;
+    // Bytes currently reserved by the pool, scratch buffers included.
+    virtual size_t GetMemoryUsage() const = 0;
+    // Implementation defined name of the component type (typeid).
+    virtual const char *GetComponentName() const = 0;
+};
+
+struct PoolStats
+{
+    const char *componentName;
+    size_t size;
+    size_t memoryUsage;
 };
 
+// Components are kept packed in a contiguous array. Two index maps link
+// an entity id to its slot in the array and back, so components can be
+// moved around (on removal or when the pool gets sorted) without the
+// entities noticing.
 template <typename T>
 class Pool : public BasePool
 {
 private:
     std::vector<T> _data;
+    std::vector<int> _entityIdToIndex;
+    std::vector<int> _indexToEntityId;
+
+    friend class PoolSnapshot<T>;
+
+    // Scratch buffers reused between sorts to avoid reallocating them.
+    std::vector<uint32_t> _sortKeys;
+    std::vector<size_t> _sortOrder;
+    std::vector<size_t> _sortDisplaced;
+    std::vector<T> _sortData;
+    std::vector<int> _sortEntityIds;
 
 public:
-    Pool(int size = 100) { Resize(size); }
+    Pool(int capacity = 100)
+    {
+        _data.reserve(capacity);
+        _indexToEntityId.reserve(capacity);
+    }
     virtual ~Pool() = default;
     bool IsEmpty() const { return _data.empty(); }
-    size_t GetSize() const { return _data.size(); }
-    void Resize(size_t size) { _data.resize(size); }
-    void Clear() { _data.clear(); }
-    void Add(T object) { _data.push_back(object); }
-    const T &Get(size_t index) const { return _data[index]; }
-    const T &operator[](size_t index) const { return _data[index]; }
+    size_t GetSize() const override { return _data.size(); }
+    size_t GetMemoryUsage() const override
+    {
+        return (_data.capacity() + _sortData.capacity()) * sizeof(T) +
+               (_entityIdToIndex.capacity() + _indexToEntityId.capacity() + _sortEntityIds.capacity()) * sizeof(int) +
+               _sortKeys.capacity() * sizeof(uint32_t) +
+               (_sortOrder.capacity() + _sortDisplaced.capacity()) * sizeof(size_t);
+    }
+    const char *GetComponentName() const override { return typeid(T).name(); }
+    void Clear()
+    {
+        _data.clear();
+        _entityIdToIndex.clear();
+        _indexToEntityId.clear();
+    }
+
+    bool Has(int entityId) const { return IndexOf(entityId) >= 0; }
+    int IndexOf(int entityId) const
+    {
+        return entityId < (int)_entityIdToIndex.size() ? _entityIdToIndex[entityId] : -1;
+    }
+    int GetEntityIdAt(size_t index) const { return _indexToEntityId[index]; }
+
+    void Set(int entityId, T object)
+    {
+        const int index = IndexOf(entityId);
+        if (index >= 0)
+        {
+            _data[index] = std::move(object);
+            return;
+        }
+        if (entityId >= (int)_entityIdToIndex.size())
+        {
+            _entityIdToIndex.resize(entityId + 1, -1);
+        }
+        _entityIdToIndex[entityId] = _data.size();
+        _indexToEntityId.push_back(entityId);
+        _data.push_back(std::move(object));
+    }
+
+    void Remove(int entityId)
+    {
+        const int index = IndexOf(entityId);
+        if (index < 0)
+        {
+            return;
+        }
+        // Move the last element into the freed slot to keep the array packed.
+        const int lastIndex = _data.size() - 1;
+        if (index != lastIndex)
+        {
+            SwapAt(index, lastIndex);
+        }
+        _entityIdToIndex[entityId] = -1;
+        _indexToEntityId.pop_back();
+        _data.pop_back();
+    }
+
+    void RemoveEntityFromPool(int entityId) override { Remove(entityId); }
+
+    T &Get(int entityId) { return _data[_entityIdToIndex[entityId]]; }
+    const T &Get(int entityId) const { return _data[_entityIdToIndex[entityId]]; }
+    T &operator[](int entityId) { return Get(entityId); }
+    const T &operator[](int entityId) const { return Get(entityId); }
+    T &GetAt(size_t index) { return _data[index]; }
+    const T &GetAt(size_t index) const { return _data[index]; }
+
+    void SwapAt(size_t a, size_t b)
+    {
+        std::swap(_data[a], _data[b]);
+        std::swap(_indexToEntityId[a], _indexToEntityId[b]);
+        _entityIdToIndex[_indexToEntityId[a]] = a;
+        _entityIdToIndex[_indexToEntityId[b]] = b;
+    }
+
+    // Sorts the packed array by the key returned by keyOf(component).
+    // Meant to be called every frame: when only a few components are out
+    // of place (the usual case once things only move a bit per frame)
+    // those are picked out, sorted and merged back in a single linear
+    // pass. When the pool is badly out of order it does a full sort
+    // instead. Returns how many elements were out of place.
+    template <typename TKeyFunc>
+    size_t SortBy(TKeyFunc keyOf);
+
+    // Moves the components of the entities that are also in the lead pool
+    // to the front of this pool, in the same order as they are in there.
+    // Returns how many elements were moved.
+    template <typename TLead>
+    size_t AlignTo(const Pool<TLead> &lead);
 };
 
+template <typename T>
+template <typename TKeyFunc>
+size_t Pool<T>::SortBy(TKeyFunc keyOf)
+{
+    const size_t size = _data.size();
+    _sortKeys.resize(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        _sortKeys[i] = keyOf(_data[i]);
+    }
+
+    // Split the pool in a sorted run that stays where it is and the
+    // elements that are out of place. An element is out of place when it
+    // is smaller than the last one kept or bigger than the one after it
+    // (so a single element that jumped forward doesn't push everything
+    // after it out of the run).
+    _sortOrder.clear();
+    _sortDisplaced.clear();
+    for (size_t i = 0; i < size; i++)
+    {
+        const bool belowRun = !_sortOrder.empty() && _sortKeys[i] < _sortKeys[_sortOrder.back()];
+        const bool aboveNext = i + 1 < size && _sortKeys[i] > _sortKeys[i + 1];
+        if (belowRun || aboveNext)
+        {
+            _sortDisplaced.push_back(i);
+        }
+        else
+        {
+            _sortOrder.push_back(i);
+        }
+    }
+
+    const size_t numDisplaced = _sortDisplaced.size();
+    if (numDisplaced == 0)
+    {
+        return 0;
+    }
+
+    auto byKey = [this](size_t a, size_t b)
+    { return _sortKeys[a] < _sortKeys[b]; };
+
+    if (numDisplaced * 8 > size)
+    {
+        // Too much disorder for the merge, sort everything.
+        _sortOrder.resize(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            _sortOrder[i] = i;
+        }
+        std::stable_sort(_sortOrder.begin(), _sortOrder.end(), byKey);
+    }
+    else
+    {
+        std::stable_sort(_sortDisplaced.begin(), _sortDisplaced.end(), byKey);
+        const size_t runSize = _sortOrder.size();
+        _sortOrder.insert(_sortOrder.end(), _sortDisplaced.begin(), _sortDisplaced.end());
+        std::inplace_merge(_sortOrder.begin(), _sortOrder.begin() + runSize, _sortOrder.end(), byKey);
+    }
+
+    // Apply the new order, _sortOrder[i] is the old index of what goes in i.
+    _sortData.clear();
+    _sortData.reserve(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        _sortData.push_back(std::move(_data[_sortOrder[i]]));
+    }
+    _data.swap(_sortData);
+
+    _sortEntityIds.assign(_indexToEntityId.begin(), _indexToEntityId.end());
+    for (size_t i = 0; i < size; i++)
+    {
+        const int entityId = _sortEntityIds[_sortOrder[i]];
+        _indexToEntityId[i] = entityId;
+        _entityIdToIndex[entityId] = i;
+    }
+    return numDisplaced;
+}
+
+template <typename T>
+template <typename TLead>
+size_t Pool<T>::AlignTo(const Pool<TLead> &lead)
+{
+    size_t next = 0;
+    size_t moves = 0;
+    for (size_t i = 0; i < lead.GetSize() && next < _data.size(); i++)
+    {
+        const int index = IndexOf(lead.GetEntityIdAt(i));
+        if (index < 0)
+        {
+            continue;
+        }
+        if ((size_t)index != next)
+        {
+            SwapAt(index, next);
+            moves++;
+        }
+        next++;
+    }
+    return moves;
+}
+
 class Registry
 {
 private:
-    // Total number of current entities.
+    // Total number of entity ids handed out so far (alive or free).
     int _numEntities = 0;
     std::set<Entity> _entitiesToBeAdded;
     std::set<Entity> _entitiesToBeKilled;
 
+    // Ids of killed entities, reused by CreateEntity before growing.
+    std::deque<int> _freeIds;
+
+    // Scratch buffer flagging the ids killed (or leaving a system) in the
+    // current Update.
+    std::vector<bool> _isKilled;
+
     // Keeps pointers to pools of components for each possible component.
-    // The pools are as big as the maximum amount of entities.
+    // Each pool only holds the components of the entities that have them.
     std::vector<std::unique_ptr<BasePool>> _componentPools;
 
     // Keeps track of which components are 'enabled' for each entity.
     std::vector<Signature> _entityComponentSignature;
 
+    // Current generation of each id, bumped when its entity is killed.
+    std::vector<uint32_t> _entityGenerations;
+
+    // The signature each entity's system membership was last worked out
+    // from. Entities whose components changed since are queued in
+    // _entitiesChanged (once, _isChanged flags them) and moved between
+    // systems by the next Update.
+    std::vector<Signature> _systemSignature;
+    std::vector<Entity> _entitiesChanged;
+    std::vector<bool> _isChanged;
+
+    // Queues e for its system membership to be checked again.
+    void MarkChanged(int entityId, Entity e);
+    void UpdateSystemMembership();
+
     // Keeps track of all of the systems.
     // They can be accessed by the type, which is convenient.
     std::unordered_map<std::type_index, std::unique_ptr<System>> _systems;
@@ -112,6 +431,18 @@ private:
 public:
     Registry() = default;
     Entity CreateEntity();
+    void KillEntity(Entity e);
+    // Creates count entities at once and appends them to out, for
+    // spawning a whole group (a streamed in chunk of the level).
+    void CreateEntities(size_t count, std::vector<Entity> &out);
+    void KillEntities(const std::vector<Entity> &entities);
+    // False once e was killed (from the next Update on), even if its id
+    // was given to a new entity.
+    bool IsAlive(Entity e) const;
+    // The handle of the entity that has entityId now.
+    Entity GetEntity(int entityId) const;
+    size_t GetNumAliveEntities() const;
+    std::vector<PoolStats> GetPoolStats() const;
     // Component functions
     template <typename TComponent, typename... TArgs>
     void AddComponent(Entity e, TArgs &&...args);
@@ -121,6 +452,16 @@ public:
     bool HasComponent(Entity e) const;
     template <typename TComponent>
     TComponent &GetComponent(Entity e) const;
+    template <typename TComponent>
+    Pool<TComponent> *GetPool() const;
+
+    // Sorts the TComponent pool by keyOf(component) (see Pool::SortBy)
+    // and then lays out the TGrouped pools in the same entity order, so
+    // systems reading those components together walk memory linearly.
+    // The entity lists of the systems requiring TComponent are reordered
+    // to match. Entities stay valid, references to components do not.
+    template <typename TComponent, typename... TGrouped, typename TKeyFunc>
+    size_t SortComponents(TKeyFunc keyOf);
     // System functions
     template <typename TSystem, typename... TArgs>
     void AddSystem(TArgs &&...args);
@@ -138,28 +479,58 @@ public:
     // get added or removed in the middle of other systems
     // being updated.
     void Update();
-    void KillEntity();
-
-    // TODO:
-    //
-    // CreateEntity()
-    // KillEntity()
-    //
-    // AddComponent(Entity e)
-    // RemoveComponent(Entity e)
-    // HasComponent(Entity e)
-    //
-    // AddSystem()
-    // RemoveSystem()
-    // HasSystem()
-    // GetSystem()
 };
 
 template <typename TComponent>
 void System::RequireComponent()
 {
-    const auto componentId = Component<TComponent>::GetId();
-    _componentSignature.set();
+    SignatureFilter<TComponent>::Apply(_componentSignature, _excludedSignature, _optionalSignature);
+    _filterMask = _componentSignature | _excludedSignature;
+}
+
+template <typename TComponent>
+void System::SortEntities(const Pool<TComponent> &pool)
+{
+    // Pool indices are unique, so scatter the entities to the slot of
+    // their component and read them back in order instead of sorting.
+    _sortSlots.assign(pool.GetSize(), Entity(-1));
+    size_t numOutside = 0;
+    for (auto entity : _entities)
+    {
+        const int index = pool.IndexOf(entity.GetId());
+        if (index >= 0)
+        {
+            _sortSlots[index] = entity;
+        }
+        else
+        {
+            // Entities without the component (it was removed after they
+            // joined the system) go at the end, in their current order.
+            _entities[numOutside++] = entity;
+        }
+    }
+    std::rotate(_entities.begin(), _entities.begin() + numOutside, _entities.end());
+    size_t next = 0;
+    for (Entity entity : _sortSlots)
+    {
+        if (entity.GetId() >= 0)
+        {
+            _entities[next++] = entity;
+        }
+    }
+}
+
+inline void Registry::MarkChanged(int entityId, Entity e)
+{
+    if (entityId >= (int)_isChanged.size())
+    {
+        _isChanged.resize(_entityComponentSignature.size(), false);
+    }
+    if (!_isChanged[entityId])
+    {
+        _isChanged[entityId] = true;
+        _entitiesChanged.push_back(e);
+    }
 }
 
 template <typename TComponent, typename... TArgs>
@@ -168,9 +539,9 @@ void Registry::AddComponent(Entity e, TArgs &&...args)
     const auto componentId = Component<TComponent>::GetId();
     const auto entityId = e.GetId();
 
-    if (componentId > _componentPools.size())
+    if (componentId >= (int)_componentPools.size())
     {
-        _componentPools.resize(componentId + 1, nullptr);
+        _componentPools.resize(componentId + 1);
     }
 
     if (!_componentPools[componentId])
@@ -178,18 +549,14 @@ void Registry::AddComponent(Entity e, TArgs &&...args)
         _componentPools[componentId] = std::make_unique<Pool<TComponent>>();
     }
 
-    auto componentPool = _componentPools[componentId];
-
-    if (entityId > componentPool->GetSize())
-    {
-        componentPool->Resize(_numEntities);
-    }
+    auto componentPool = GetPool<TComponent>();
 
     TComponent newComponent(std::forward<TArgs>(args)...);
 
-    componentPool->Set(entityId, newComponent);
+    componentPool->Set(entityId, std::move(newComponent));
 
     _entityComponentSignature[entityId].set(componentId);
+    MarkChanged(entityId, e);
 }
 
 template <typename TComponent>
@@ -198,7 +565,13 @@ void Registry::RemoveComponent(Entity e)
     const auto componentId = Component<TComponent>::GetId();
     const auto entityId = e.GetId();
 
+    if (auto componentPool = GetPool<TComponent>())
+    {
+        componentPool->Remove(entityId);
+    }
+
     _entityComponentSignature[entityId].set(componentId, false);
+    MarkChanged(entityId, e);
 }
 
 template <typename TComponent>
@@ -210,6 +583,60 @@ bool Registry::HasComponent(Entity e) const
     return _entityComponentSignature[entityId].test(componentId);
 }
 
+template <typename TComponent>
+TComponent &Registry::GetComponent(Entity e) const
+{
+    return GetPool<TComponent>()->Get(e.GetId());
+}
+
+template <typename TComponent>
+Pool<TComponent> *Registry::GetPool() const
+{
+    const auto componentId = Component<TComponent>::GetId();
+    if (componentId >= (int)_componentPools.size())
+    {
+        return nullptr;
+    }
+    return static_cast<Pool<TComponent> *>(_componentPools[componentId].get());
+}
+
+template <typename TComponent, typename... TGrouped, typename TKeyFunc>
+size_t Registry::SortComponents(TKeyFunc keyOf)
+{
+    auto lead = GetPool<TComponent>();
+    if (!lead)
+    {
+        return 0;
+    }
+
+    size_t moves = lead->SortBy(keyOf);
+
+    // Grouped pools only move the components that are out of place, so
+    // once they are aligned this is a linear scan with no swaps.
+    [[maybe_unused]] auto alignToLead = [&](auto *pool)
+    {
+        if (pool)
+        {
+            moves += pool->AlignTo(*lead);
+        }
+    };
+    (alignToLead(GetPool<TGrouped>()), ...);
+
+    if (moves > 0)
+    {
+        const auto componentId = Component<TComponent>::GetId();
+        for (auto &system : _systems)
+        {
+            if (system.second->GetSignature().test(componentId))
+            {
+                system.second->SortEntities(*lead);
+            }
+        }
+    }
+
+    return moves;
+}
+
 template <typename TSystem, typename... TArgs>
 void Registry::AddSystem(TArgs &&...args)
 {
@@ -235,7 +662,7 @@ template <typename TSystem>
 TSystem &Registry::GetSystem() const
 {
     auto systemPos = _systems.find(std::type_index(typeid(TSystem)));
-    return *std::static_pointer_cast<TSystem>(systemPos->second);
+    return *static_cast<TSystem *>(systemPos->second.get());
 }
 
 #endif
\ No newline at end of file
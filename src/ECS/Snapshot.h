@@ -0,0 +1,208 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "ECS.h"
+
+// Read-only copy of a component pool taken at a given point in time.
+// It has the same packed layout as the pool, so taking it is a plain
+// copy of its arrays (which reuses the memory of previous snapshots).
+// The entities are stored with the generation they had when the
+// snapshot was taken, so they compare equal to the live handles.
+template <typename T>
+class PoolSnapshot
+{
+private:
+    std::vector<T> _data;
+    std::vector<int> _entityIdToIndex;
+    std::vector<Entity> _indexToEntity;
+
+public:
+    void CopyFrom(const Pool<T> &pool, const Registry &registry)
+    {
+        _data.assign(pool._data.begin(), pool._data.end());
+        _entityIdToIndex.assign(pool._entityIdToIndex.begin(), pool._entityIdToIndex.end());
+        _indexToEntity.clear();
+        _indexToEntity.reserve(pool._indexToEntityId.size());
+        for (int entityId : pool._indexToEntityId)
+        {
+            _indexToEntity.push_back(registry.GetEntity(entityId));
+        }
+    }
+
+    void Clear()
+    {
+        _data.clear();
+        _entityIdToIndex.clear();
+        _indexToEntity.clear();
+    }
+
+    size_t GetSize() const { return _data.size(); }
+    // False for a stale handle whose id belonged to someone else when
+    // the snapshot was taken.
+    bool Has(Entity e) const
+    {
+        const int entityId = e.GetId();
+        return entityId >= 0 && entityId < (int)_entityIdToIndex.size() && _entityIdToIndex[entityId] >= 0 &&
+               _indexToEntity[_entityIdToIndex[entityId]] == e;
+    }
+    const T &Get(Entity e) const { return _data[_entityIdToIndex[e.GetId()]]; }
+    const T &GetAt(size_t index) const { return _data[index]; }
+    Entity GetEntityAt(size_t index) const { return _indexToEntity[index]; }
+};
+
+// Consistent read-only view of a set of component pools: all of them
+// were copied during the same call to SnapshotBuffer::Publish.
+template <typename... TComponents>
+class RegistrySnapshot
+{
+private:
+    std::tuple<PoolSnapshot<TComponents>...> _pools;
+    uint64_t _version = 0;
+    // SnapshotRefs holding the snapshot. Dropping one releases the reads
+    // made through it, Publish acquires them before reusing the snapshot.
+    mutable std::atomic<int> _numRefs{0};
+
+    template <typename... T>
+    friend class SnapshotBuffer;
+    template <typename TSnapshot>
+    friend class SnapshotRef;
+
+public:
+    uint64_t GetVersion() const { return _version; }
+
+    template <typename TComponent>
+    const PoolSnapshot<TComponent> &GetPool() const { return std::get<PoolSnapshot<TComponent>>(_pools); }
+    template <typename TComponent>
+    bool HasComponent(Entity e) const { return GetPool<TComponent>().Has(e); }
+    template <typename TComponent>
+    const TComponent &GetComponent(Entity e) const { return GetPool<TComponent>().Get(e); }
+};
+
+// Keeps a snapshot from being reused by SnapshotBuffer::Publish for as
+// long as it (or a copy of it) is around. Empty until the first Publish.
+template <typename TSnapshot>
+class SnapshotRef
+{
+private:
+    const TSnapshot *_snapshot = nullptr;
+
+    void Release()
+    {
+        if (_snapshot)
+        {
+            _snapshot->_numRefs.fetch_sub(1, std::memory_order_release);
+            _snapshot = nullptr;
+        }
+    }
+
+public:
+    SnapshotRef() = default;
+    explicit SnapshotRef(const TSnapshot *snapshot) : _snapshot(snapshot)
+    {
+        if (_snapshot)
+        {
+            _snapshot->_numRefs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    SnapshotRef(const SnapshotRef &other) : SnapshotRef(other._snapshot) {}
+    SnapshotRef(SnapshotRef &&other) noexcept : _snapshot(std::exchange(other._snapshot, nullptr)) {}
+    SnapshotRef &operator=(SnapshotRef other) noexcept
+    {
+        std::swap(_snapshot, other._snapshot);
+        return *this;
+    }
+    ~SnapshotRef() { Release(); }
+
+    void Reset() { Release(); }
+    const TSnapshot *Get() const { return _snapshot; }
+    const TSnapshot *operator->() const { return _snapshot; }
+    const TSnapshot &operator*() const { return *_snapshot; }
+    explicit operator bool() const { return _snapshot != nullptr; }
+};
+
+// Publishes snapshots of the TComponents pools for other threads to read.
+//
+// The main thread calls Publish (typically once per frame, after the
+// systems have updated) while any thread can call Acquire to get the
+// latest snapshot. A snapshot stays alive and unchanged for as long as
+// someone holds a SnapshotRef to it, the buffer has to outlive them.
+// Publish reuses the memory of the snapshots nobody holds anymore, so in
+// the common case of readers that let go of a snapshot before the next
+// one is published, only two of them ever exist and publishing
+// allocates nothing.
+template <typename... TComponents>
+class SnapshotBuffer
+{
+public:
+    using SnapshotType = RegistrySnapshot<TComponents...>;
+    using Ref = SnapshotRef<SnapshotType>;
+
+private:
+    std::vector<std::unique_ptr<SnapshotType>> _snapshots;
+    // Written by the main thread with _latestMutex held.
+    const SnapshotType *_latest = nullptr;
+    // Guards reading _latest and taking a reference to it, so a snapshot
+    // is never reused between the two. Never held while copying pools.
+    mutable std::mutex _latestMutex;
+    uint64_t _version = 0;
+
+    SnapshotType *GetFreeSnapshot()
+    {
+        // References are only taken to _latest, with the mutex held, so
+        // any other snapshot without references stays that way. The
+        // acquire pairs with the release of the last reference dropped,
+        // the reads made through it are done before the copy starts.
+        for (auto &snapshot : _snapshots)
+        {
+            if (snapshot.get() != _latest && snapshot->_numRefs.load(std::memory_order_acquire) == 0)
+            {
+                return snapshot.get();
+            }
+        }
+        _snapshots.push_back(std::make_unique<SnapshotType>());
+        return _snapshots.back().get();
+    }
+
+public:
+    // Main thread only.
+    void Publish(const Registry &registry)
+    {
+        SnapshotType *snapshot = GetFreeSnapshot();
+        snapshot->_version = ++_version;
+        (CopyPool<TComponents>(registry, std::get<PoolSnapshot<TComponents>>(snapshot->_pools)), ...);
+
+        std::lock_guard<std::mutex> lock(_latestMutex);
+        _latest = snapshot;
+    }
+
+    // Safe to call from any thread. Returns an empty reference until the
+    // first Publish.
+    Ref Acquire() const
+    {
+        std::lock_guard<std::mutex> lock(_latestMutex);
+        return Ref(_latest);
+    }
+
+private:
+    template <typename TComponent>
+    static void CopyPool(const Registry &registry, PoolSnapshot<TComponent> &pool)
+    {
+        if (auto source = registry.GetPool<TComponent>())
+        {
+            pool.CopyFrom(*source, registry);
+        }
+        else
+        {
+            pool.Clear();
+        }
+    }
+};
+
+#endif
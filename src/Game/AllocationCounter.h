@@ -0,0 +1,12 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <cstdint>
+
+// Counts the heap allocations made through operator new in the game
+// executable (AllocationCounter.cpp replaces the global operators).
+namespace AllocationCounter {
+    uint64_t GetAllocationCount();
+}
+
+#endif
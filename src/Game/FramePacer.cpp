@@ -0,0 +1,90 @@
+#include "FramePacer.h"
+#include "../Logger/Logger.h"
+#include <algorithm>
+#include <cstdio>
+
+// Never spin less than this, SDL_Delay can always be a bit late.
+static const double MIN_SPIN_WINDOW_MS = 0.5;
+static const double MAX_SPIN_WINDOW_MS = 4.0;
+
+FramePacer::FramePacer(int targetFps, size_t historySize)
+    : m_frequency(SDL_GetPerformanceFrequency()),
+      m_ticksPerFrame(0),
+      m_spinWindowMs(1.0),
+      m_frameTimesMs(historySize, 0.0f),
+      m_nextFrameTime(0),
+      m_recordedFrames(0) {
+    SetTargetFps(targetFps);
+    Restart();
+}
+
+void FramePacer::SetTargetFps(int targetFps) {
+    m_ticksPerFrame = targetFps > 0 ? m_frequency / targetFps : 0;
+}
+
+void FramePacer::Restart() {
+    m_lastFrameEnd = SDL_GetPerformanceCounter();
+    m_nextDeadline = m_lastFrameEnd + m_ticksPerFrame;
+}
+
+void FramePacer::WaitForNextFrame() {
+    if (m_ticksPerFrame > 0) {
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (now < m_nextDeadline) {
+            const double remainingMs = double(m_nextDeadline - now) * 1000.0 / m_frequency;
+            const double sleepMs = remainingMs - m_spinWindowMs;
+            if (sleepMs >= 1.0) {
+                const Uint64 sleepStart = now;
+                SDL_Delay(Uint32(sleepMs));
+                now = SDL_GetPerformanceCounter();
+
+                // Learn how late SDL_Delay wakes up and keep the spin
+                // window a bit above that.
+                const double oversleptMs = double(now - sleepStart) * 1000.0 / m_frequency - Uint32(sleepMs);
+                const double target = std::clamp(oversleptMs * 1.5, MIN_SPIN_WINDOW_MS, MAX_SPIN_WINDOW_MS);
+                m_spinWindowMs += (target - m_spinWindowMs) * (target > m_spinWindowMs ? 0.5 : 0.05);
+            }
+            while (now < m_nextDeadline) {
+                now = SDL_GetPerformanceCounter();
+            }
+            m_nextDeadline += m_ticksPerFrame;
+        } else {
+            // Missed the deadline: start counting again from now instead
+            // of rushing the following frames to catch up.
+            m_nextDeadline = now + m_ticksPerFrame;
+        }
+    }
+
+    const Uint64 frameEnd = SDL_GetPerformanceCounter();
+    RecordFrameTime(double(frameEnd - m_lastFrameEnd) * 1000.0 / m_frequency);
+    m_lastFrameEnd = frameEnd;
+}
+
+void FramePacer::RecordFrameTime(double frameTimeMs) {
+    m_frameTimesMs[m_nextFrameTime] = float(frameTimeMs);
+    m_nextFrameTime = (m_nextFrameTime + 1) % m_frameTimesMs.size();
+    m_recordedFrames++;
+}
+
+FrameTimeStats FramePacer::GetStats() const {
+    FrameTimeStats stats;
+    const size_t count = std::min<size_t>(m_recordedFrames, m_frameTimesMs.size());
+    if (count == 0) {
+        return stats;
+    }
+    std::vector<float> sorted(m_frameTimesMs.begin(), m_frameTimesMs.begin() + count);
+    std::sort(sorted.begin(), sorted.end());
+    stats.p50Ms = sorted[count / 2];
+    stats.p99Ms = sorted[std::min(count - 1, count * 99 / 100)];
+    stats.maxMs = sorted.back();
+    stats.frames = count;
+    return stats;
+}
+
+void FramePacer::LogStats() const {
+    const FrameTimeStats stats = GetStats();
+    char line[128];
+    snprintf(line, sizeof(line), "Frame times over the last %d frames: p50 %.3f ms  p99 %.3f ms  max %.3f ms",
+             stats.frames, stats.p50Ms, stats.p99Ms, stats.maxMs);
+    Logger::Log(line);
+}
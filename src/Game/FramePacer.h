@@ -0,0 +1,50 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <SDL2/SDL.h>
+#include <cstddef>
+#include <vector>
+
+// Frame time percentiles in milliseconds.
+struct FrameTimeStats {
+    double p50Ms = 0.0;
+    double p99Ms = 0.0;
+    double maxMs = 0.0;
+    int frames = 0;
+};
+
+// Keeps frames evenly spaced at the target rate.
+//
+// SDL_Delay only has millisecond resolution and the OS may oversleep by
+// a scheduler quantum, so the pacer sleeps until shortly before the
+// deadline and spins on the performance counter for the rest. The spin
+// window adapts to how much the OS has been oversleeping lately.
+class FramePacer {
+    private:
+        Uint64 m_frequency;
+        // Performance counter ticks per frame, 0 disables pacing.
+        Uint64 m_ticksPerFrame;
+        Uint64 m_nextDeadline;
+        Uint64 m_lastFrameEnd;
+        // How long before the deadline to stop sleeping and start spinning.
+        double m_spinWindowMs;
+
+        // Ring of the latest frame times so memory stays bounded.
+        std::vector<float> m_frameTimesMs;
+        size_t m_nextFrameTime;
+        int m_recordedFrames;
+
+        void RecordFrameTime(double frameTimeMs);
+
+    public:
+        FramePacer(int targetFps = 0, size_t historySize = 8192);
+        void SetTargetFps(int targetFps);
+        // Resets the deadline, call after long stalls like level loading.
+        void Restart();
+        // Blocks until the current frame is due to end.
+        void WaitForNextFrame();
+        FrameTimeStats GetStats() const;
+        void LogStats() const;
+};
+
+#endif
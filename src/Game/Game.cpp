@@ -1,5 +1,15 @@
 #include "Game.h"
 #include "../Logger/Logger.h"
+#include "../Logger/FlightRecorder.h"
+#include "../ECS/ECS.h"
+#include "../Profiler/Profiler.h"
+#include "AllocationCounter.h"
+#include "../Systems/SpatialSortSystem.h"
+#include "../Systems/MovementSystem.h"
+#include "../Systems/RenderSystem.h"
+#include "../Components/TransformComponent.h"
+#include "../Components/RigidBodyComponent.h"
+#include "../Components/SpriteComponent.h"
 #include <SDL2/SDL.h>
 #include "SDL2/SDL_timer.h"
 #include <SDL2/SDL_events.h>
@@ -8,8 +18,39 @@
 #include <SDL2/SDL_video.h>
 #include <SDL2/SDL_image.h>
 #include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+static double CounterToMs(Uint64 ticks) {
+    return double(ticks) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+// Movement and rendering read these along with the transform, so keep
+// them laid out in the same spatial order.
+using GameSpatialSortSystem = SpatialSortSystem<RigidBodyComponent, SpriteComponent>;
 
 Game::Game() {
+    m_window = nullptr;
+    m_renderer = nullptr;
+    m_offscreenSurface = nullptr;
+    m_headless = false;
+    m_lockstep = false;
+    m_isRunning = false;
+    m_initializeMs = 0.0;
+    m_tileSize = 32;
+    m_tileScale = 1.0f;
+    m_tileset = 0;
+    m_treeTexture = 0;
+    m_chunkBudget = 0;
+    m_spriteBatching = true;
+    m_worldSize = glm::vec2(0.0f);
+    m_cameraPosition = glm::vec2(0.0f);
+    m_previousCameraPosition = glm::vec2(0.0f);
+    m_cameraInput = glm::vec2(0.0f);
+    m_registry = std::make_unique<Registry>();
+    m_assetStore = std::make_unique<AssetStore>();
     Logger::Log("Created a game instance");
 }
 
@@ -18,23 +59,94 @@ Game::~Game() {
     Logger::Log("Destroyed the game instance");
 }
 
-void Game::Initialize(int targetFps) {
-    if (SDL_Init(SDL_INIT_EVERYTHING) != 0) {
+bool Game::Initialize(const GameOptions& options) {
+    const Uint64 initializeStart = SDL_GetPerformanceCounter();
+    m_headless = options.headless;
+    if (m_headless) {
+        // Has to be set before SDL initializes the video subsystem.
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+    }
+
+    const Uint32 subsystems = m_headless ? SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_EVENTS : SDL_INIT_EVERYTHING;
+    if (SDL_Init(subsystems) != 0) {
         Logger::Err("Error initializing SDL");
-        return;
+        return false;
+    }
+
+    m_windowWidth = 1920;
+    m_windowHeight = 1080;
+
+    if (!(m_headless ? CreateHeadlessRenderer() : CreateWindowAndRenderer())) {
+        return false;
+    }
+
+    m_assetStore->SetAtlasPageSize(options.atlasPageSize);
+    m_assetStore->Initialize(m_renderer);
+    if (!options.assetArchive.empty()) {
+        std::ifstream archive(options.assetArchive);
+        if (archive) {
+            m_assetStore->OpenArchive(options.assetArchive, "./assets/");
+        } else {
+            Logger::Log("No asset archive at " + options.assetArchive + ", loading the asset files");
+        }
+    }
+    if (options.hotReload && !m_headless) {
+        m_assetStore->WatchForChanges("./assets/");
+    }
+    m_perfOverlay.Initialize(m_renderer, m_windowWidth, m_windowHeight);
+
+    // Headless runs go as fast as they can.
+    m_framePacer.SetTargetFps(m_headless ? 0 : options.targetFps);
+    m_profileFrames = options.profileFrames;
+    m_profileOutput = options.profileOutput;
+    m_logDump = options.logDump;
+    if (!options.flightRecorder.empty() && FlightRecorder::Open(options.flightRecorder)) {
+        Profiler::SetScopeSink(FlightRecorder::RecordScope);
+    }
+    m_maxFrames = options.maxFrames;
+    m_frameCount = 0;
+    int simulationHz = options.simulationHz;
+    if (!options.replayInput.empty() && !m_inputReplayer.Open(options.replayInput, simulationHz)) {
+        return false;
+    }
+    if (!options.recordInput.empty() && !m_inputRecorder.Open(options.recordInput, simulationHz)) {
+        return false;
+    }
+    if (simulationHz != options.simulationHz) {
+        Logger::Log("Using the recorded simulation rate of " + std::to_string(simulationHz) + " Hz");
     }
+    m_lockstep = m_headless || m_inputReplayer.IsOpen();
+    m_fixedDeltaT = 1.0 / simulationHz;
+    m_maxStepsPerFrame = options.maxStepsPerFrame;
+    m_accumulator = 0.0;
+    m_previousFrameCounter = SDL_GetPerformanceCounter();
+    m_tick = 0;
+    m_interpolationAlpha = 1.0f;
+    m_lastFrameSeconds = 0.0;
+    m_mapFile = options.mapFile;
+    m_tilesetFile = options.tilesetFile;
+    m_tileSize = options.tileSize;
+    m_tileScale = options.tileScale;
+    m_chunkBudget = options.chunkBudget;
+    m_spriteBatching = options.spriteBatching;
+    if (options.stressScenario) {
+        m_stressScenario = std::make_unique<StressScenario>(options.stressConfig);
+    }
+    m_isRunning = true;
+    m_initializeMs = CounterToMs(SDL_GetPerformanceCounter() - initializeStart);
+    return true;
+}
 
+bool Game::CreateWindowAndRenderer() {
     // NOTE: The dispMode variable will also hold interesting infromation
     // like the refresh rate and the format.
     SDL_DisplayMode dispMode;
     if (SDL_GetCurrentDisplayMode(0, &dispMode) != 0) {
         Logger::Err("Error getting current display mode");
-        return;
+        return false;
     }
     // m_windowWidth = dispMode.w;
     // m_windowHeight = dispMode.h;
-    m_windowWidth = 1920;
-    m_windowHeight = 1080;
 
     m_window = SDL_CreateWindow(
         "2D Game Engine",
@@ -46,7 +158,7 @@ void Game::Initialize(int targetFps) {
     );
     if (!m_window) {
         Logger::Err("Error creating SDL window");
-        return;
+        return false;
     }
 
     m_renderer = SDL_CreateRenderer(
@@ -57,75 +169,455 @@ void Game::Initialize(int targetFps) {
     );
     if (!m_renderer) {
         Logger::Err("Error creating SDL renderer");
-        return;
+        return false;
     }
 
     /*if (SDL_SetWindowFullscreen(m_window, SDL_WINDOW_FULLSCREEN) != 0) {*/
     /*    std::cerr << "Error making window fullscreen." << std::endl;*/
     /*    return;*/
     /*}*/
+    return true;
+}
 
-    m_targetMsPerFrame = 1000.0f / targetFps;
-    m_msPreviousFrame = SDL_GetTicks();
-    m_isRunning = true;
+bool Game::CreateHeadlessRenderer() {
+    m_offscreenSurface = SDL_CreateRGBSurfaceWithFormat(0, m_windowWidth, m_windowHeight, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (!m_offscreenSurface) {
+        Logger::Err(std::string("Error creating offscreen surface: ") + SDL_GetError());
+        return false;
+    }
+
+    m_renderer = SDL_CreateSoftwareRenderer(m_offscreenSurface);
+    if (!m_renderer) {
+        Logger::Err(std::string("Error creating software renderer: ") + SDL_GetError());
+        return false;
+    }
+
+    Logger::Log(std::string("Running headless with the ") + SDL_GetCurrentVideoDriver() + " video driver");
+    return true;
 }
 
 void Game::Setup() {
-    // TODO: Initialize systems
-    // TODO: Use the registry to create entities
+    PROFILE_SCOPE("Game::Setup");
+    const Uint64 setupStart = SDL_GetPerformanceCounter();
+
+    // Keeps the transforms in spatial order so systems walking them
+    // touch memory in the same order entities are laid out in the world.
+    m_registry->AddSystem<GameSpatialSortSystem>();
+    m_registry->AddSystem<MovementSystem>();
+    m_registry->AddSystem<RenderSystem>();
+    m_registry->GetSystem<RenderSystem>().SetBatching(m_spriteBatching);
+
+    const Uint64 loadStart = SDL_GetPerformanceCounter();
+
+    // Everything the level needs gets queued first and then loaded in
+    // one go, decoding on all cores.
+    m_tileset = m_assetStore->QueueTexture("tileset", m_tilesetFile);
+    m_treeTexture = m_assetStore->QueueTexture("tree", "./assets/images/tree.png");
+    // A baked map is already parsed, only a file needs loading.
+    const ArchiveEntry* bakedMap = m_assetStore->FindArchived(m_mapFile);
+    m_tilemap = std::make_unique<Tilemap>();
+    if (bakedMap && bakedMap->type == ARCHIVE_TILEMAP) {
+        m_tilemap->SetView(
+            int(bakedMap->width), int(bakedMap->height),
+            reinterpret_cast<const uint16_t*>(m_assetStore->GetArchivedData(*bakedMap))
+        );
+    } else {
+        m_assetStore->QueueJob([this]() { m_tilemap->Load(m_mapFile); });
+    }
+    if (m_stressScenario) {
+        m_stressScenario->QueueAssets(*m_assetStore);
+    }
+    const AssetLoadStats loadStats = m_assetStore->LoadQueued();
+    const Uint64 spawnStart = SDL_GetPerformanceCounter();
+
+    if (m_tilemap->GetNumCols() == 0) {
+        Logger::Err("Error loading the map " + m_mapFile + ", the level will be empty");
+    }
+    m_worldSize = glm::vec2(m_tilemap->GetNumCols(), m_tilemap->GetNumRows()) * (m_tileSize * m_tileScale);
+    m_tilemapRenderer.SetMemoryBudget(m_chunkBudget);
+    // Headless runs and replays have to do the same work every time.
+    m_tilemapRenderer.SetSynchronous(m_lockstep);
+    m_tilemapRenderer.SetChunkCallbacks(
+        [this](int chunkIndex, const SDL_Rect& tiles) { SpawnChunkEntities(chunkIndex, tiles); },
+        [this](int chunkIndex, const SDL_Rect&) { KillChunkEntities(chunkIndex); }
+    );
+    m_tilemapRenderer.Initialize(m_renderer, m_tilemap.get(), m_tileset, m_tileSize, m_tileScale);
+    if (m_stressScenario) {
+        // Units need somewhere to go even without a map.
+        m_stressScenario->Setup(*m_registry, m_tilemap->GetNumCols() > 0 ? m_worldSize : glm::vec2(1600.0f, 1280.0f));
+    }
+
+    const Uint64 setupEnd = SDL_GetPerformanceCounter();
+    char summary[256];
+    snprintf(
+        summary, sizeof(summary),
+        "Startup took %.1f ms: initialize %.1f ms, systems %.1f ms, "
+        "asset decode %.1f ms (%d textures, %d jobs, %d threads), "
+        "texture upload %.1f ms (%d atlas pages), spawn %.1f ms",
+        m_initializeMs + CounterToMs(setupEnd - setupStart),
+        m_initializeMs,
+        CounterToMs(loadStart - setupStart),
+        loadStats.decodeMs, loadStats.numTextures, loadStats.numJobs, loadStats.numThreads,
+        loadStats.uploadMs, loadStats.numAtlasPages,
+        CounterToMs(setupEnd - spawnStart)
+    );
+    Logger::Log(summary);
 }
 
 void Game::Run() {
     Setup();
+    // Don't let the time spent in Setup count as simulation time.
+    m_previousFrameCounter = SDL_GetPerformanceCounter();
+    m_framePacer.Restart();
+    const Uint64 runStart = SDL_GetPerformanceCounter();
+    if (m_profileFrames > 0) {
+        Profiler::CaptureFrames(m_profileFrames, m_profileOutput);
+    }
     while (m_isRunning) {
-        ProcessInput();
-        Update();
-        Render();
+        const uint64_t frameAllocations = AllocationCounter::GetAllocationCount();
+        {
+            PROFILE_SCOPE("Frame");
+            ProcessInput();
+            if (!m_isRunning) {
+                break;
+            }
+            Update();
+            Render();
+            PROFILE_SCOPE("WaitForNextFrame");
+            m_framePacer.WaitForNextFrame();
+        }
+        PROFILE_FRAME_END();
+
+        m_frameBreakdown.allocations =
+            AllocationCounter::GetAllocationCount() - frameAllocations - m_frameBreakdown.overlayAllocations;
+        m_perfOverlay.RecordFrame(m_frameBreakdown);
+        FlightRecorder::RecordFrame({
+            0, 0,
+            float(m_lastFrameSeconds * 1000.0),
+            m_frameBreakdown.updateMs,
+            m_frameBreakdown.renderMs,
+            m_frameBreakdown.presentMs,
+            uint32_t(m_frameBreakdown.allocations),
+            uint32_t(m_registry->GetNumAliveEntities())
+        });
+
+        m_frameCount++;
+        if (m_maxFrames > 0 && m_frameCount >= m_maxFrames) {
+            m_isRunning = false;
+        }
+    }
+    m_inputRecorder.Close(m_tick);
+    const double runSeconds = double(SDL_GetPerformanceCounter() - runStart) / SDL_GetPerformanceFrequency();
+    char summary[160];
+    snprintf(summary, sizeof(summary), "Ran %d frames (%llu simulation steps) in %.3f s (%.1f fps)",
+             m_frameCount, (unsigned long long)m_tick, runSeconds, m_frameCount / std::max(runSeconds, 1e-9));
+    Logger::Log(summary);
+    LogSystemTimings();
+    m_framePacer.LogStats();
+    if (!m_logDump.empty()) {
+        Logger::DumpHistory(m_logDump);
+    }
+}
+
+template <typename TFunc>
+void Game::TimeSystem(const char* name, TFunc&& update) {
+    PROFILE_SCOPE(name);
+    const Uint64 start = SDL_GetPerformanceCounter();
+    update();
+    const double elapsedMs = CounterToMs(SDL_GetPerformanceCounter() - start);
+
+    auto timingPos = m_systemTimings.find(name);
+    if (timingPos == m_systemTimings.end()) {
+        timingPos = m_systemTimings.emplace(name, SystemTiming()).first;
+    }
+    auto& timing = timingPos->second;
+    timing.lastMs = elapsedMs;
+    timing.totalMs += elapsedMs;
+    timing.maxMs = std::max(timing.maxMs, elapsedMs);
+    timing.samples++;
+}
+
+void Game::LogSystemTimings() const {
+    Logger::Log(
+        "System timings over " + std::to_string(m_frameCount) + " frames (" +
+        std::to_string(m_tick) + " simulation steps):"
+    );
+    for (const auto& [name, timing] : m_systemTimings) {
+        char line[128];
+        snprintf(line, sizeof(line), "  %-24s avg %8.3f ms  max %8.3f ms",
+                 name.c_str(), timing.totalMs / std::max(timing.samples, 1), timing.maxMs);
+        Logger::Log(line);
     }
 }
 
 void Game::ProcessInput() {
+    PROFILE_SCOPE("Game::ProcessInput");
     SDL_Event sdlEvent;
     while (SDL_PollEvent(&sdlEvent)) {
-        switch (sdlEvent.type) {
-            case SDL_QUIT:
+        if (m_perfOverlay.ProcessEvent(sdlEvent) || HandleDiagnosticsKey(sdlEvent)) {
+            continue;
+        }
+        if (m_inputReplayer.IsOpen()) {
+            // Live input would change the replayed session, it can only
+            // be cut short by closing the window.
+            if (sdlEvent.type == SDL_QUIT) {
                 m_isRunning = false;
-            break;
-            case SDL_KEYDOWN:
-                if (sdlEvent.key.keysym.sym == SDLK_ESCAPE) {
-                    m_isRunning = false;
-                }
-            break;
+            }
+            continue;
+        }
+        m_inputRecorder.Record(m_tick, sdlEvent);
+        HandleEvent(sdlEvent);
+    }
+
+    if (m_inputReplayer.IsOpen()) {
+        while (m_inputReplayer.Poll(m_tick, sdlEvent)) {
+            HandleEvent(sdlEvent);
+        }
+        if (m_inputReplayer.IsFinished(m_tick)) {
+            m_isRunning = false;
+        }
+    }
+}
+
+bool Game::HandleDiagnosticsKey(const SDL_Event& sdlEvent) {
+    if (sdlEvent.type != SDL_KEYDOWN && sdlEvent.type != SDL_KEYUP) {
+        return false;
+    }
+    const SDL_Keycode key = sdlEvent.key.keysym.sym;
+    if (key != SDLK_F1 && key != SDLK_F2) {
+        return false;
+    }
+    if (sdlEvent.type == SDL_KEYUP) {
+        return true;
+    }
+    if (key == SDLK_F1) {
+        m_perfOverlay.Toggle();
+    }
+#ifdef ENABLE_PROFILER
+    // F2 starts a capture, pressing it again writes it out.
+    if (key == SDLK_F2) {
+        if (Profiler::IsCapturing()) {
+            Profiler::EndCapture();
+            Profiler::WriteChromeTrace(m_profileOutput);
+        } else {
+            Logger::Log("Profiler capture started");
+            Profiler::BeginCapture();
+        }
+    }
+#endif
+    return true;
+}
+
+void Game::HandleEvent(const SDL_Event& sdlEvent) {
+    switch (sdlEvent.type) {
+        case SDL_QUIT:
+            m_isRunning = false;
+        break;
+        case SDL_KEYDOWN:
+        case SDL_KEYUP: {
+            // Held arrow keys pan the camera.
+            const float pressed = sdlEvent.type == SDL_KEYDOWN ? 1.0f : 0.0f;
+            switch (sdlEvent.key.keysym.sym) {
+                case SDLK_LEFT: m_cameraInput.x = -pressed; break;
+                case SDLK_RIGHT: m_cameraInput.x = pressed; break;
+                case SDLK_UP: m_cameraInput.y = -pressed; break;
+                case SDLK_DOWN: m_cameraInput.y = pressed; break;
+            }
+            if (sdlEvent.type == SDL_KEYUP) {
+                break;
+            }
+            if (sdlEvent.key.keysym.sym == SDLK_ESCAPE) {
+                m_isRunning = false;
+            }
+        break;
         }
+        // The renderer lost its render targets (Direct3D does on device
+        // loss), the baked chunks are gone.
+        case SDL_RENDER_TARGETS_RESET:
+        case SDL_RENDER_DEVICE_RESET:
+            m_tilemapRenderer.Invalidate();
+        break;
     }
 }
 
+void Game::UpdateCamera(float deltaT) {
+    // Pixels per second.
+    static const float CAMERA_SPEED = 600.0f;
+    m_previousCameraPosition = m_cameraPosition;
+    m_cameraPosition += m_cameraInput * (CAMERA_SPEED * deltaT);
+    const glm::vec2 maxPosition = glm::max(m_worldSize - glm::vec2(m_windowWidth, m_windowHeight), glm::vec2(0.0f));
+    m_cameraPosition = glm::clamp(m_cameraPosition, glm::vec2(0.0f), maxPosition);
+}
+
 void Game::Update() {
-    const unsigned int frameStartTime = SDL_GetTicks();
-    const float deltaT = float(frameStartTime - m_msPreviousFrame) / 1000.0f;
-    m_msPreviousFrame = frameStartTime;
+    PROFILE_SCOPE("Game::Update");
+    const Uint64 frameCounter = SDL_GetPerformanceCounter();
+    m_lastFrameSeconds = double(frameCounter - m_previousFrameCounter) / SDL_GetPerformanceFrequency();
+    // Lockstep frames don't depend on wall time so every run of the same
+    // number of frames (or of the same replay) does the same work.
+    m_accumulator += m_lockstep ? m_fixedDeltaT : m_lastFrameSeconds;
+    m_previousFrameCounter = frameCounter;
 
+    // Run as many fixed steps as the elapsed time covers, the remainder
+    // carries over to the next frame.
+    int steps = 0;
+    while (m_accumulator >= m_fixedDeltaT) {
+        if (steps == m_maxStepsPerFrame) {
+            // Can't keep up: drop the time we are behind rather than
+            // spiraling into ever longer frames.
+            m_accumulator = std::fmod(m_accumulator, m_fixedDeltaT);
+            break;
+        }
+        FixedUpdate(m_fixedDeltaT);
+        m_accumulator -= m_fixedDeltaT;
+        steps++;
+    }
+    m_interpolationAlpha = float(m_accumulator / m_fixedDeltaT);
+    m_frameBreakdown.updateMs = CounterToMs(SDL_GetPerformanceCounter() - frameCounter);
+}
 
-    // TODO: Make systems update
+void Game::FixedUpdate(float deltaT) {
+    // Remember where everything was so Render can interpolate from there.
+    if (auto transforms = m_registry->GetPool<TransformComponent>()) {
+        for (size_t i = 0; i < transforms->GetSize(); i++) {
+            auto& transform = transforms->GetAt(i);
+            transform.previousPosition = transform.position;
+            transform.previousRotation = transform.rotation;
+        }
+    }
 
+    // Add/remove the entities that were created/killed during the last step.
+    TimeSystem("Registry", [&]() { m_registry->Update(); });
 
-    const unsigned int frameTime = SDL_GetTicks() - frameStartTime;
-    if (frameTime >= 0 && frameTime < m_targetMsPerFrame) {
-        SDL_Delay(m_targetMsPerFrame - frameTime);
+    if (m_stressScenario) {
+        TimeSystem("StressScenario", [&]() { m_stressScenario->Update(*m_registry, deltaT); });
     }
+    TimeSystem("MovementSystem", [&]() { m_registry->GetSystem<MovementSystem>().Update(*m_registry, deltaT); });
+    TimeSystem("SpatialSortSystem", [&]() { m_registry->GetSystem<GameSpatialSortSystem>().Update(*m_registry); });
+    UpdateCamera(deltaT);
+
+    m_tick++;
 }
 
 void Game::Render() {
+    PROFILE_SCOPE("Game::Render");
+    const Uint64 renderStart = SDL_GetPerformanceCounter();
+    // Textures can only be swapped on the render thread, between frames.
+    // The chunks have the old tileset baked in.
+    if (m_assetStore->ApplyReloads() > 0) {
+        m_tilemapRenderer.Invalidate();
+    }
+    if (std::unique_ptr<Tilemap> tilemap = m_assetStore->TakeReloadedTilemap(m_mapFile)) {
+        ReloadMap(std::move(tilemap));
+    }
     SDL_SetRenderDrawColor(m_renderer, 21, 21, 21, 255);
     SDL_RenderClear(m_renderer);
 
-    // Render game objects... 
+    const glm::vec2 cameraPosition = glm::mix(m_previousCameraPosition, m_cameraPosition, m_interpolationAlpha);
+    const SDL_Rect camera = {int(cameraPosition.x), int(cameraPosition.y), m_windowWidth, m_windowHeight};
+    TimeSystem("TilemapRenderer", [&]() { m_tilemapRenderer.Render(m_renderer, *m_assetStore, camera); });
+    TimeSystem("RenderSystem", [&]() { m_registry->GetSystem<RenderSystem>().Update(m_renderer, *m_registry, *m_assetStore, m_interpolationAlpha, camera); });
+    const Uint64 overlayStart = SDL_GetPerformanceCounter();
+    m_frameBreakdown.renderMs = CounterToMs(overlayStart - renderStart);
+
+    // The overlay measures itself apart so it doesn't skew what it shows.
+    const uint64_t overlayAllocations = AllocationCounter::GetAllocationCount();
+    if (m_perfOverlay.IsVisible()) {
+        PROFILE_SCOPE("PerfOverlay");
+        PerfOverlayStats stats;
+        stats.systemTimings = &m_systemTimings;
+        stats.systemEntityCounts = {
+            {"MovementSystem", m_registry->GetSystem<MovementSystem>().GetEntities().size()},
+            {"RenderSystem", m_registry->GetSystem<RenderSystem>().GetEntities().size()},
+            {"SpatialSortSystem", m_registry->GetSystem<GameSpatialSortSystem>().GetEntities().size()},
+        };
+        stats.poolStats = m_registry->GetPoolStats();
+        stats.numEntities = m_registry->GetNumAliveEntities();
+        stats.numSpritesDrawn = m_registry->GetSystem<RenderSystem>().GetNumDrawn();
+        stats.numDrawCalls = m_registry->GetSystem<RenderSystem>().GetNumDrawCalls();
+        m_perfOverlay.Render(stats, float(m_lastFrameSeconds));
+    }
+    m_frameBreakdown.overlayAllocations = AllocationCounter::GetAllocationCount() - overlayAllocations;
+    const Uint64 presentStart = SDL_GetPerformanceCounter();
+    m_frameBreakdown.overlayMs = CounterToMs(presentStart - overlayStart);
 
-    SDL_RenderPresent(m_renderer);
+    {
+        PROFILE_SCOPE("SDL_RenderPresent");
+        SDL_RenderPresent(m_renderer);
+    }
+    m_frameBreakdown.presentMs = CounterToMs(SDL_GetPerformanceCounter() - presentStart);
+}
+
+void Game::ReloadMap(std::unique_ptr<Tilemap> tilemap) {
+    PROFILE_SCOPE("Game::ReloadMap");
+    // The loader thread reads the old map until the renderer is
+    // destroyed, which also kills the entities of every resident chunk.
+    m_tilemapRenderer.Destroy();
+    m_tilemap = std::move(tilemap);
+    m_worldSize = glm::vec2(m_tilemap->GetNumCols(), m_tilemap->GetNumRows()) * (m_tileSize * m_tileScale);
+    m_tilemapRenderer.Initialize(m_renderer, m_tilemap.get(), m_tileset, m_tileSize, m_tileScale);
+    Logger::Log(
+        "Reloaded the map " + m_mapFile + " (" + std::to_string(m_tilemap->GetNumCols()) + "x" +
+        std::to_string(m_tilemap->GetNumRows()) + " tiles)"
+    );
+}
+
+void Game::SpawnChunkEntities(int chunkIndex, const SDL_Rect& tiles) {
+    PROFILE_SCOPE("Game::SpawnChunkEntities");
+    // Trees on some of the grass tiles, picked by hashing the tile's
+    // position so a chunk gets the same ones every time it is loaded.
+    const uint16_t GRASS_TILE = 21;
+    std::vector<SDL_Point> trees;
+    for (int row = tiles.y; row < tiles.y + tiles.h; row++) {
+        for (int col = tiles.x; col < tiles.x + tiles.w; col++) {
+            const uint32_t hash = (uint32_t(col) * 73856093u) ^ (uint32_t(row) * 19349663u);
+            if (m_tilemap->GetTile(col, row) == GRASS_TILE && hash % 61 == 0) {
+                trees.push_back({col, row});
+            }
+        }
+    }
+    if (trees.empty()) {
+        return;
+    }
+    // Created in one go, chunks have to come in without hitches.
+    std::vector<Entity> entities;
+    m_registry->CreateEntities(trees.size(), entities);
+    int treeWidth = 0;
+    int treeHeight = 0;
+    m_assetStore->GetTextureSize(m_treeTexture, treeWidth, treeHeight);
+    const float tileSize = m_tileSize * m_tileScale;
+    for (size_t i = 0; i < trees.size(); i++) {
+        const glm::vec2 position(trees[i].x * tileSize, trees[i].y * tileSize);
+        m_registry->AddComponent<TransformComponent>(entities[i], position, glm::vec2(m_tileScale, m_tileScale), 0.0);
+        m_registry->AddComponent<SpriteComponent>(entities[i], m_treeTexture, treeWidth, treeHeight, 1);
+    }
+    m_chunkEntities[chunkIndex] = std::move(entities);
+}
+
+void Game::KillChunkEntities(int chunkIndex) {
+    auto it = m_chunkEntities.find(chunkIndex);
+    if (it == m_chunkEntities.end()) {
+        return;
+    }
+    m_registry->KillEntities(it->second);
+    m_chunkEntities.erase(it);
 }
 
 void Game::Destroy() {
+    Profiler::SetScopeSink(nullptr);
+    // Get the last messages into the recording before it is detached.
+    Logger::Flush();
+    FlightRecorder::Close();
+    m_perfOverlay.Destroy();
+    // Textures belong to the renderer, they have to go first.
+    m_tilemapRenderer.Destroy();
+    m_assetStore->Clear();
     SDL_DestroyRenderer(m_renderer);
-    SDL_DestroyWindow(m_window);
+    if (m_window) {
+        SDL_DestroyWindow(m_window);
+    }
+    if (m_offscreenSurface) {
+        SDL_FreeSurface(m_offscreenSurface);
+    }
     SDL_Quit();
 }
@@ -1,19 +1,178 @@
 #ifndef GAME_H
 #define GAME_H
 #include <SDL2/SDL.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../ECS/ECS.h"
+#include "../AssetStore/AssetStore.h"
+#include "StressScenario.h"
+#include "FramePacer.h"
+#include "PerfOverlay.h"
+#include "InputRecording.h"
+#include "TilemapRenderer.h"
+#include "../AssetStore/Tilemap.h"
+#include <glm/glm.hpp>
+
+struct GameOptions {
+    int targetFps = 120;
+    // The simulation always advances in fixed steps of 1 / simulationHz
+    // seconds, no matter the frame rate.
+    int simulationHz = 120;
+    // Max simulation steps per frame. When a frame takes so long that it
+    // needs more to catch up, the extra time is dropped (the game slows
+    // down) instead of making the next frame even longer.
+    int maxStepsPerFrame = 8;
+    // Stop after this many frames, 0 runs until the window is closed.
+    int maxFrames = 0;
+    // Run without a window or GPU: SDL's dummy video driver and a
+    // software renderer drawing to an offscreen surface. Frames aren't
+    // paced and every frame advances the simulation by exactly one step.
+    bool headless = false;
+    // Write the input to this file / play it back from this file instead
+    // of reading live input. Replays advance one step per frame.
+    std::string recordInput;
+    std::string replayInput;
+    // Capture the first profileFrames frames into profileOutput (0 = off).
+    int profileFrames = 0;
+    std::string profileOutput = "profile_capture.json";
+    // Write the in-memory log history here as a binary dump on exit,
+    // 2dge_logexpand turns it back into text.
+    std::string logDump;
+    // Memory-mapped file holding the last seconds of frame timings,
+    // profiler scopes and log messages, survives crashes. Read it with
+    // 2dge_flightdump. Off (empty) by default: while it is on every
+    // profiler scope gets timed, not just the ones in a capture.
+    std::string flightRecorder;
+    // Archive baked by 2dge_assetbaker to load ./assets/ from. The loose
+    // files are used when it doesn't exist, empty disables it.
+    std::string assetArchive = "./assets.pak";
+    // Reload images under ./assets/ when they change on disk. Off in
+    // headless mode.
+    bool hotReload = true;
+    // Side of the texture atlas pages images get packed into, 0 gives
+    // every image a texture of its own.
+    int atlasPageSize = 2048;
+    // The level's map (CSV or .tmb, see Tilemap.h) and the tileset its
+    // tile ids index into, with tiles of tileSize pixels drawn tileScale
+    // times their size.
+    std::string mapFile = "./assets/tilemaps/jungle.map";
+    std::string tilesetFile = "./assets/tilemaps/jungle.png";
+    int tileSize = 32;
+    float tileScale = 2.0f;
+    // Memory the loaded map chunks (their tiles and baked textures) may
+    // take before the ones out of view get evicted.
+    size_t chunkBudget = 256 << 20;
+    // Submit sprites sharing a texture with one SDL_RenderGeometry call
+    // instead of one SDL_RenderCopyEx each.
+    bool spriteBatching = true;
+    // Populate the world with the stress scenario instead of the level.
+    bool stressScenario = false;
+    StressScenarioConfig stressConfig;
+};
+
+// Accumulated cost of a system over the frames it ran.
+struct SystemTiming {
+    double totalMs = 0.0;
+    double maxMs = 0.0;
+    double lastMs = 0.0;
+    int samples = 0;
+};
 
 class Game {
     private:
      SDL_Window* m_window;
      SDL_Renderer* m_renderer;
+     // Render target of the software renderer in headless mode.
+     SDL_Surface* m_offscreenSurface;
+     bool m_headless;
+     // Advance exactly one fixed step per frame instead of following the
+     // wall clock, for headless runs and replays.
+     bool m_lockstep;
      bool m_isRunning;
-     float m_targetMsPerFrame;
-     int m_msPreviousFrame;
+     FramePacer m_framePacer;
+     int m_maxFrames;
+     int m_frameCount;
+
+     // Fixed timestep state.
+     double m_fixedDeltaT;
+     int m_maxStepsPerFrame;
+     double m_accumulator;
+     Uint64 m_previousFrameCounter;
+     // Simulation steps run so far.
+     Uint64 m_tick;
+     float m_interpolationAlpha;
+
+     std::unique_ptr<Registry> m_registry;
+     std::unique_ptr<AssetStore> m_assetStore;
+     std::unique_ptr<StressScenario> m_stressScenario;
+
+     // The level.
+     std::string m_mapFile;
+     std::string m_tilesetFile;
+     int m_tileSize;
+     float m_tileScale;
+     // Replaced as a whole when the map file changes on disk.
+     std::unique_ptr<Tilemap> m_tilemap;
+     TextureHandle m_tileset;
+     TextureHandle m_treeTexture;
+     size_t m_chunkBudget;
+     bool m_spriteBatching;
+     TilemapRenderer m_tilemapRenderer;
+     // Entities of the map chunks that are loaded, by chunk index. They
+     // come and go with their chunk.
+     std::unordered_map<int, std::vector<Entity>> m_chunkEntities;
+     // In pixels.
+     glm::vec2 m_worldSize;
+
+     // Top left corner of the part of the world on screen, moved with the
+     // arrow keys in fixed steps and interpolated like the entities.
+     glm::vec2 m_cameraPosition;
+     glm::vec2 m_previousCameraPosition;
+     glm::vec2 m_cameraInput;
+     // std::less<> so lookups by const char* don't build a std::string.
+     std::map<std::string, SystemTiming, std::less<>> m_systemTimings;
+
+     PerfOverlay m_perfOverlay;
+     FrameBreakdown m_frameBreakdown;
+     double m_lastFrameSeconds;
+     // Time from the start of Initialize until it was done, reported
+     // with the other startup phases once Setup is done.
+     double m_initializeMs;
+
+     int m_profileFrames;
+     std::string m_profileOutput;
+     std::string m_logDump;
+
+     InputRecorder m_inputRecorder;
+     InputReplayer m_inputReplayer;
+
+     template <typename TFunc>
+     void TimeSystem(const char* name, TFunc&& update);
+     void LogSystemTimings() const;
+     bool CreateWindowAndRenderer();
+     bool CreateHeadlessRenderer();
+     void FixedUpdate(float deltaT);
+     // F1 (perf overlay) and F2 (profiler capture) only change what gets
+     // measured, never the simulation, so they are kept out of input
+     // recordings and work during replays. True if the event was one.
+     bool HandleDiagnosticsKey(const SDL_Event& sdlEvent);
+     void HandleEvent(const SDL_Event& sdlEvent);
+     void UpdateCamera(float deltaT);
+     // Swaps in a new version of the map. The chunks and their entities
+     // go with the old one and come back from the new one when seen.
+     void ReloadMap(std::unique_ptr<Tilemap> tilemap);
+     void SpawnChunkEntities(int chunkIndex, const SDL_Rect& tiles);
+     void KillChunkEntities(int chunkIndex);
 
     public:
         Game();
         ~Game();
-        void Initialize(int targetFps);
+        // False if the game can't run (no renderer, unreadable input
+        // files), Destroy is still safe to call then.
+        bool Initialize(const GameOptions& options);
         void Setup();
         void Run();
         void ProcessInput();
@@ -0,0 +1,162 @@
+#include "InputRecording.h"
+#include "../Logger/Logger.h"
+#include <climits>
+#include <cstring>
+
+namespace {
+    const char kMagic[8] = {'2', 'D', 'G', 'E', 'I', 'N', 'P', 'T'};
+    const uint32_t kVersion = 1;
+    const size_t kRecordSize = 12;
+
+    // Everything is stored little endian regardless of the host.
+    void PutU16(unsigned char* out, uint16_t value) {
+        out[0] = value & 0xff;
+        out[1] = value >> 8;
+    }
+
+    void PutU32(unsigned char* out, uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            out[i] = (value >> (8 * i)) & 0xff;
+        }
+    }
+
+    uint16_t GetU16(const unsigned char* in) {
+        return uint16_t(in[0] | (in[1] << 8));
+    }
+
+    uint32_t GetU32(const unsigned char* in) {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++) {
+            value |= uint32_t(in[i]) << (8 * i);
+        }
+        return value;
+    }
+}
+
+bool InputRecorder::Open(const std::string& path, int simulationHz) {
+    m_file.open(path, std::ios::binary | std::ios::trunc);
+    if (!m_file) {
+        Logger::Err("Could not open input recording " + path);
+        return false;
+    }
+    unsigned char header[16];
+    memcpy(header, kMagic, sizeof(kMagic));
+    PutU32(header + 8, kVersion);
+    PutU32(header + 12, uint32_t(simulationHz));
+    m_file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    m_numRecords = 0;
+    Logger::Log("Recording input to " + path);
+    return true;
+}
+
+void InputRecorder::Write(const InputRecord& record) {
+    unsigned char bytes[kRecordSize];
+    PutU32(bytes, record.tick);
+    bytes[4] = uint8_t(record.kind);
+    bytes[5] = record.repeat;
+    PutU16(bytes + 6, record.modifiers);
+    PutU32(bytes + 8, uint32_t(record.keycode));
+    m_file.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+    m_numRecords++;
+}
+
+void InputRecorder::Record(uint64_t tick, const SDL_Event& event) {
+    if (!m_file.is_open()) {
+        return;
+    }
+    InputRecord record = {uint32_t(tick), InputRecordKind::Quit, 0, 0, 0};
+    switch (event.type) {
+        case SDL_QUIT:
+        break;
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+            record.kind = event.type == SDL_KEYDOWN ? InputRecordKind::KeyDown : InputRecordKind::KeyUp;
+            record.repeat = event.key.repeat;
+            record.modifiers = event.key.keysym.mod;
+            record.keycode = event.key.keysym.sym;
+        break;
+        default:
+            return;
+    }
+    Write(record);
+}
+
+void InputRecorder::Close(uint64_t tick) {
+    if (!m_file.is_open()) {
+        return;
+    }
+    Write({uint32_t(tick), InputRecordKind::End, 0, 0, 0});
+    m_file.close();
+    Logger::Log("Recorded " + std::to_string(m_numRecords) + " input events over " + std::to_string(tick) + " ticks");
+}
+
+bool InputReplayer::Open(const std::string& path, int& simulationHz) {
+    std::ifstream file(path, std::ios::binary);
+    unsigned char header[16];
+    if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+        memcmp(header, kMagic, sizeof(kMagic)) != 0) {
+        Logger::Err("Not an input recording: " + path);
+        return false;
+    }
+    if (GetU32(header + 8) != kVersion) {
+        Logger::Err("Unsupported input recording version " + std::to_string(GetU32(header + 8)) + " in " + path);
+        return false;
+    }
+    const uint32_t recordedHz = GetU32(header + 12);
+    if (recordedHz == 0 || recordedHz > uint32_t(INT_MAX)) {
+        Logger::Err("Invalid simulation rate " + std::to_string(recordedHz) + " Hz in " + path);
+        return false;
+    }
+    simulationHz = int(recordedHz);
+
+    m_records.clear();
+    unsigned char bytes[kRecordSize];
+    while (file.read(reinterpret_cast<char*>(bytes), sizeof(bytes))) {
+        InputRecord record;
+        record.tick = GetU32(bytes);
+        record.kind = InputRecordKind(bytes[4]);
+        record.repeat = bytes[5];
+        record.modifiers = GetU16(bytes + 6);
+        record.keycode = int32_t(GetU32(bytes + 8));
+        m_records.push_back(record);
+    }
+    if (m_records.empty() || m_records.back().kind != InputRecordKind::End) {
+        Logger::Err("Input recording " + path + " is truncated, replaying what is there");
+    }
+    m_next = 0;
+    m_isOpen = true;
+    Logger::Log("Replaying " + std::to_string(m_records.size()) + " input events from " + path);
+    return true;
+}
+
+bool InputReplayer::Poll(uint64_t tick, SDL_Event& event) {
+    if (m_next == m_records.size() || m_records[m_next].tick > tick ||
+        m_records[m_next].kind == InputRecordKind::End) {
+        return false;
+    }
+    const InputRecord& record = m_records[m_next++];
+    memset(&event, 0, sizeof(event));
+    switch (record.kind) {
+        case InputRecordKind::Quit:
+            event.type = SDL_QUIT;
+        break;
+        case InputRecordKind::KeyDown:
+        case InputRecordKind::KeyUp:
+            event.type = record.kind == InputRecordKind::KeyDown ? SDL_KEYDOWN : SDL_KEYUP;
+            event.key.state = record.kind == InputRecordKind::KeyDown ? SDL_PRESSED : SDL_RELEASED;
+            event.key.repeat = record.repeat;
+            event.key.keysym.sym = record.keycode;
+            event.key.keysym.scancode = SDL_GetScancodeFromKey(record.keycode);
+            event.key.keysym.mod = record.modifiers;
+        break;
+        default:
+            // Unknown kinds come from a newer writer, skip them.
+            return Poll(tick, event);
+    }
+    return true;
+}
+
+bool InputReplayer::IsFinished(uint64_t tick) const {
+    return m_next == m_records.size() ||
+        (m_records[m_next].kind == InputRecordKind::End && m_records[m_next].tick <= tick);
+}
@@ -0,0 +1,65 @@
+#ifndef INPUT_RECORDING_H
+#define INPUT_RECORDING_H
+
+#include <SDL2/SDL.h>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Input recordings are a small header followed by fixed size records,
+// each stamped with the simulation tick the event was applied before.
+// Replaying one with a fixed timestep reproduces the same session step
+// for step, which makes perf runs comparable across builds.
+//
+// Only the events the game reacts to are kept: quitting and key presses.
+enum class InputRecordKind : uint8_t {
+    Quit = 1,
+    KeyDown = 2,
+    KeyUp = 3,
+    // Written when the recording stops so a replay runs as many ticks.
+    End = 4
+};
+
+struct InputRecord {
+    uint32_t tick;
+    InputRecordKind kind;
+    uint8_t repeat;
+    uint16_t modifiers;
+    int32_t keycode;
+};
+
+class InputRecorder {
+    private:
+        std::ofstream m_file;
+        size_t m_numRecords = 0;
+
+        void Write(const InputRecord& record);
+
+    public:
+        bool Open(const std::string& path, int simulationHz);
+        bool IsOpen() const { return m_file.is_open(); }
+        // Records the event if it is one the game reacts to.
+        void Record(uint64_t tick, const SDL_Event& event);
+        void Close(uint64_t tick);
+};
+
+class InputReplayer {
+    private:
+        std::vector<InputRecord> m_records;
+        size_t m_next = 0;
+        bool m_isOpen = false;
+
+    public:
+        // Loads the whole recording, simulationHz receives the rate it
+        // was recorded at.
+        bool Open(const std::string& path, int& simulationHz);
+        bool IsOpen() const { return m_isOpen; }
+        // Pops the next event due at or before tick. Returns false once
+        // the events for this tick are exhausted.
+        bool Poll(uint64_t tick, SDL_Event& event);
+        // The end of the recording has been reached.
+        bool IsFinished(uint64_t tick) const;
+};
+
+#endif
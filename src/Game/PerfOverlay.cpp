@@ -0,0 +1,175 @@
+#include "PerfOverlay.h"
+#include "Game.h"
+#include <imgui/imgui.h>
+#include <imgui/imgui_sdl.h>
+#include <algorithm>
+#include <cstdlib>
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+
+// typeid names are mangled with GCC/Clang, make them readable.
+static std::string ComponentName(const char* name) {
+#if defined(__GNUG__)
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (status == 0 && demangled) {
+        std::string result(demangled);
+        std::free(demangled);
+        return result;
+    }
+#endif
+    return name;
+}
+
+PerfOverlay::PerfOverlay()
+    : m_visible(false),
+      m_updateMs(HISTORY_SIZE, 0.0f),
+      m_renderMs(HISTORY_SIZE, 0.0f),
+      m_presentMs(HISTORY_SIZE, 0.0f),
+      m_overlayMs(HISTORY_SIZE, 0.0f),
+      m_nextSample(0) {
+    m_logRecords.reserve(CONSOLE_LINES);
+}
+
+void PerfOverlay::Initialize(SDL_Renderer* renderer, int windowWidth, int windowHeight) {
+    ImGui::CreateContext();
+    ImGuiSDL::Initialize(renderer, windowWidth, windowHeight);
+}
+
+void PerfOverlay::Destroy() {
+    // Never initialized, the game failed to start.
+    if (!ImGui::GetCurrentContext()) {
+        return;
+    }
+    ImGuiSDL::Deinitialize();
+    ImGui::DestroyContext();
+}
+
+bool PerfOverlay::ProcessEvent(const SDL_Event& event) {
+    if (!m_visible) {
+        return false;
+    }
+    ImGuiIO& io = ImGui::GetIO();
+    if (event.type == SDL_MOUSEWHEEL) {
+        io.MouseWheel += event.wheel.y;
+    }
+    return io.WantCaptureMouse && (event.type == SDL_MOUSEBUTTONDOWN || event.type == SDL_MOUSEWHEEL);
+}
+
+void PerfOverlay::RecordFrame(const FrameBreakdown& frame) {
+    m_updateMs[m_nextSample] = frame.updateMs;
+    m_renderMs[m_nextSample] = frame.renderMs;
+    m_presentMs[m_nextSample] = frame.presentMs;
+    m_overlayMs[m_nextSample] = frame.overlayMs;
+    m_nextSample = (m_nextSample + 1) % HISTORY_SIZE;
+    m_lastFrame = frame;
+}
+
+static void PlotFrameTimes(const char* label, const std::vector<float>& values, int offset, float lastMs) {
+    const float maxMs = std::max(1.0f, *std::max_element(values.begin(), values.end()));
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), "%.3f ms (max %.3f)", lastMs, maxMs);
+    ImGui::PlotLines(label, values.data(), values.size(), offset, overlay, 0.0f, maxMs, ImVec2(0, 50));
+}
+
+// Only the lines in view get expanded into text.
+void PerfOverlay::RenderConsole() {
+    m_logRecords.clear();
+    Logger::CopyHistory(m_logRecords, CONSOLE_LINES);
+    ImGui::BeginChild("LogLines", ImVec2(0, 300), true, ImGuiWindowFlags_HorizontalScrollbar);
+    ImGuiListClipper clipper;
+    clipper.Begin(m_logRecords.size());
+    while (clipper.Step()) {
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+            const Logger::LogRecord& record = m_logRecords[i];
+            ImVec4 color(0.6f, 1.0f, 0.6f, 1.0f);
+            if (record.level >= Logger::LEVEL_ERROR) {
+                color = ImVec4(1.0f, 0.4f, 0.4f, 1.0f);
+            } else if (record.level == Logger::LEVEL_WARN) {
+                color = ImVec4(1.0f, 0.9f, 0.4f, 1.0f);
+            } else if (record.level < Logger::LEVEL_INFO) {
+                color = ImVec4(0.6f, 0.6f, 0.6f, 1.0f);
+            }
+            ImGui::TextColored(color, "%s", Logger::FormatRecord(record).c_str());
+        }
+    }
+    // Follow new messages unless the user scrolled up.
+    if (ImGui::GetScrollY() >= ImGui::GetScrollMaxY()) {
+        ImGui::SetScrollHereY(1.0f);
+    }
+    ImGui::EndChild();
+}
+
+void PerfOverlay::Render(const PerfOverlayStats& stats, float deltaT) {
+    if (!m_visible) {
+        return;
+    }
+
+    ImGuiIO& io = ImGui::GetIO();
+    int mouseX, mouseY;
+    const Uint32 buttons = SDL_GetMouseState(&mouseX, &mouseY);
+    io.DeltaTime = std::max(deltaT, 1.0f / 1000.0f);
+    io.MousePos = ImVec2(mouseX, mouseY);
+    io.MouseDown[0] = buttons & SDL_BUTTON(SDL_BUTTON_LEFT);
+    io.MouseDown[1] = buttons & SDL_BUTTON(SDL_BUTTON_RIGHT);
+
+    ImGui::NewFrame();
+    ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowSize(ImVec2(460, 0), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("Performance (F1)")) {
+        const float cpuMs = m_lastFrame.updateMs + m_lastFrame.renderMs + m_lastFrame.presentMs;
+        ImGui::Text("Frame %.3f ms (update + render + present, overlay excluded)", cpuMs);
+        PlotFrameTimes("Update", m_updateMs, m_nextSample, m_lastFrame.updateMs);
+        PlotFrameTimes("Render", m_renderMs, m_nextSample, m_lastFrame.renderMs);
+        PlotFrameTimes("Present", m_presentMs, m_nextSample, m_lastFrame.presentMs);
+        PlotFrameTimes("Overlay", m_overlayMs, m_nextSample, m_lastFrame.overlayMs);
+        ImGui::Text(
+            "Allocations last frame: %llu (+%llu by the overlay)",
+            (unsigned long long)m_lastFrame.allocations,
+            (unsigned long long)m_lastFrame.overlayAllocations
+        );
+
+        if (ImGui::CollapsingHeader("Systems", ImGuiTreeNodeFlags_DefaultOpen)) {
+            ImGui::Columns(4);
+            ImGui::Text("System"); ImGui::NextColumn();
+            ImGui::Text("Last ms"); ImGui::NextColumn();
+            ImGui::Text("Avg ms"); ImGui::NextColumn();
+            ImGui::Text("Max ms"); ImGui::NextColumn();
+            for (const auto& [name, timing] : *stats.systemTimings) {
+                ImGui::Text("%s", name.c_str()); ImGui::NextColumn();
+                ImGui::Text("%.3f", timing.lastMs); ImGui::NextColumn();
+                ImGui::Text("%.3f", timing.totalMs / std::max(timing.samples, 1)); ImGui::NextColumn();
+                ImGui::Text("%.3f", timing.maxMs); ImGui::NextColumn();
+            }
+            ImGui::Columns(1);
+        }
+
+        if (ImGui::CollapsingHeader("Entities", ImGuiTreeNodeFlags_DefaultOpen)) {
+            ImGui::Text("Alive: %zu", stats.numEntities);
+            for (const auto& [name, count] : stats.systemEntityCounts) {
+                ImGui::BulletText("%s: %zu", name, count);
+            }
+            ImGui::Text("Sprites drawn: %zu in %zu draw calls", stats.numSpritesDrawn, stats.numDrawCalls);
+        }
+
+        if (ImGui::CollapsingHeader("Component pools", ImGuiTreeNodeFlags_DefaultOpen)) {
+            size_t totalBytes = 0;
+            for (const auto& pool : stats.poolStats) {
+                ImGui::BulletText(
+                    "%s: %zu components, %.1f KiB",
+                    ComponentName(pool.componentName).c_str(), pool.size, pool.memoryUsage / 1024.0
+                );
+                totalBytes += pool.memoryUsage;
+            }
+            ImGui::Text("Total: %.1f KiB", totalBytes / 1024.0);
+        }
+
+        if (ImGui::CollapsingHeader("Log")) {
+            RenderConsole();
+        }
+    }
+    ImGui::End();
+    ImGui::Render();
+    ImGuiSDL::Render(ImGui::GetDrawData());
+}
@@ -0,0 +1,70 @@
+#ifndef PERF_OVERLAY_H
+#define PERF_OVERLAY_H
+
+#include <SDL2/SDL.h>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../ECS/ECS.h"
+#include "../Logger/Logger.h"
+
+struct SystemTiming;
+
+// Where the time of a frame went. The overlay's own cost is kept apart
+// so it never shows up in the other numbers.
+struct FrameBreakdown {
+    float updateMs = 0.0f;
+    float renderMs = 0.0f;
+    float presentMs = 0.0f;
+    float overlayMs = 0.0f;
+    uint64_t allocations = 0;
+    uint64_t overlayAllocations = 0;
+};
+
+// Everything the overlay shows besides the frame graph.
+struct PerfOverlayStats {
+    const std::map<std::string, SystemTiming, std::less<>>* systemTimings;
+    std::vector<std::pair<const char*, size_t>> systemEntityCounts;
+    std::vector<PoolStats> poolStats;
+    size_t numEntities;
+    size_t numSpritesDrawn;
+    size_t numDrawCalls;
+};
+
+// ImGui window with the frame time graph, system timings, entity counts,
+// pool memory and the latest log messages. Toggled with F1.
+class PerfOverlay {
+    private:
+        static const int HISTORY_SIZE = 240;
+        // Log messages the console shows.
+        static const size_t CONSOLE_LINES = 256;
+
+        bool m_visible;
+        std::vector<float> m_updateMs;
+        std::vector<float> m_renderMs;
+        std::vector<float> m_presentMs;
+        std::vector<float> m_overlayMs;
+        int m_nextSample;
+        FrameBreakdown m_lastFrame;
+        // Reused every frame the console is open.
+        std::vector<Logger::LogRecord> m_logRecords;
+
+        void RenderConsole();
+
+    public:
+        PerfOverlay();
+        void Initialize(SDL_Renderer* renderer, int windowWidth, int windowHeight);
+        void Destroy();
+
+        void Toggle() { m_visible = !m_visible; }
+        bool IsVisible() const { return m_visible; }
+
+        // Feeds mouse input to ImGui, returns true if the event was for it.
+        bool ProcessEvent(const SDL_Event& event);
+        void RecordFrame(const FrameBreakdown& frame);
+        void Render(const PerfOverlayStats& stats, float deltaT);
+};
+
+#endif
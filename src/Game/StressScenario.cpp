@@ -0,0 +1,109 @@
+#include "StressScenario.h"
+#include "../Logger/Logger.h"
+#include "../Profiler/Profiler.h"
+#include "../Components/TransformComponent.h"
+#include "../Components/RigidBodyComponent.h"
+#include "../Components/SpriteComponent.h"
+#include <string>
+
+StressScenario::StressScenario(const StressScenarioConfig& config)
+    : m_config(config), m_rng(config.seed), m_worldSize(0.0f) {
+}
+
+void StressScenario::QueueAssets(AssetStore& assetStore) {
+    static const char* directions[] = {"up", "right", "down", "left"};
+    auto load = [&](const std::string& assetId) {
+        return assetStore.QueueTexture(assetId, m_config.imagesDir + assetId + ".png");
+    };
+    for (int direction = 0; direction < 4; direction++) {
+        m_pantherTextures[direction] = load(std::string("tank-panther-") + directions[direction]);
+        m_tigerTextures[direction] = load(std::string("tank-tiger-") + directions[direction]);
+        m_truckTextures[direction] = load(std::string("truck-ford-") + directions[direction]);
+    }
+    m_chopperTexture = load("chopper");
+    m_bulletTexture = load("bullet");
+}
+
+void StressScenario::Setup(Registry& registry, glm::vec2 worldSize) {
+    PROFILE_SCOPE("StressScenario::Setup");
+    m_worldSize = worldSize;
+
+    const int numUnits = m_config.numTanks + m_config.numTrucks + m_config.numChoppers + m_config.numBullets;
+    m_units.reserve(numUnits);
+    for (int i = 0; i < m_config.numTanks; i++) m_units.push_back({SpawnUnit(registry, UNIT_TANK), UNIT_TANK});
+    for (int i = 0; i < m_config.numTrucks; i++) m_units.push_back({SpawnUnit(registry, UNIT_TRUCK), UNIT_TRUCK});
+    for (int i = 0; i < m_config.numChoppers; i++) m_units.push_back({SpawnUnit(registry, UNIT_CHOPPER), UNIT_CHOPPER});
+    for (int i = 0; i < m_config.numBullets; i++) m_units.push_back({SpawnUnit(registry, UNIT_BULLET), UNIT_BULLET});
+
+    Logger::Log(
+        "Stress scenario: " + std::to_string(numUnits) + " units on a " +
+        std::to_string(int(m_worldSize.x)) + "x" + std::to_string(int(m_worldSize.y)) + " world"
+    );
+}
+
+Entity StressScenario::SpawnUnit(Registry& registry, UnitType type) {
+    static const glm::vec2 headings[] = {{0, -1}, {1, 0}, {0, 1}, {-1, 0}};
+
+    std::uniform_real_distribution<float> randomX(0.0f, m_worldSize.x);
+    std::uniform_real_distribution<float> randomY(0.0f, m_worldSize.y);
+    const int direction = m_rng() % 4;
+    const glm::vec2 position(randomX(m_rng), randomY(m_rng));
+
+    TextureHandle texture = 0;
+    int size = 32;
+    // Choppers fly over everything, bullets over the ground units.
+    int zIndex = 0;
+    float speed = m_config.unitSpeed;
+    switch (type) {
+        case UNIT_TANK:
+            texture = m_rng() % 2 ? m_pantherTextures[direction] : m_tigerTextures[direction];
+            break;
+        case UNIT_TRUCK:
+            texture = m_truckTextures[direction];
+            break;
+        case UNIT_CHOPPER:
+            texture = m_chopperTexture;
+            speed *= 2.0f;
+            zIndex = 2;
+            break;
+        case UNIT_BULLET:
+            texture = m_bulletTexture;
+            size = 4;
+            speed = m_config.bulletSpeed;
+            zIndex = 1;
+            break;
+    }
+
+    Entity entity = registry.CreateEntity();
+    registry.AddComponent<TransformComponent>(entity, position, glm::vec2(m_config.unitScale, m_config.unitScale), 0.0);
+    registry.AddComponent<RigidBodyComponent>(entity, headings[direction] * speed);
+    registry.AddComponent<SpriteComponent>(entity, texture, size, size, zIndex);
+    return entity;
+}
+
+void StressScenario::Update(Registry& registry, float deltaT) {
+    // Wrap the units around the edges so the world stays populated.
+    for (const auto& unit : m_units) {
+        auto& transform = registry.GetComponent<TransformComponent>(unit.entity);
+        glm::vec2 offset(0.0f);
+        if (transform.position.x < 0.0f) offset.x = m_worldSize.x;
+        else if (transform.position.x >= m_worldSize.x) offset.x = -m_worldSize.x;
+        if (transform.position.y < 0.0f) offset.y = m_worldSize.y;
+        else if (transform.position.y >= m_worldSize.y) offset.y = -m_worldSize.y;
+        // Move the previous position too so the unit isn't drawn
+        // sliding across the whole map.
+        transform.position += offset;
+        transform.previousPosition += offset;
+    }
+
+    if (m_units.empty()) {
+        return;
+    }
+    m_pendingChurn += m_config.churnPerSecond * m_units.size() * deltaT;
+    while (m_pendingChurn >= 1.0f) {
+        Unit& unit = m_units[m_rng() % m_units.size()];
+        registry.KillEntity(unit.entity);
+        unit.entity = SpawnUnit(registry, unit.type);
+        m_pendingChurn -= 1.0f;
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef STRESS_SCENARIO_H
+#define STRESS_SCENARIO_H
+
+#include <random>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "../ECS/ECS.h"
+#include "../AssetStore/AssetStore.h"
+
+struct StressScenarioConfig {
+    int numTanks = 4000;
+    int numTrucks = 3000;
+    int numChoppers = 1000;
+    int numBullets = 2000;
+
+    // Speed in pixels per second.
+    float unitSpeed = 40.0f;
+    float bulletSpeed = 300.0f;
+
+    // Fraction of the units killed and respawned every second.
+    float churnPerSecond = 0.05f;
+
+    unsigned int seed = 1337;
+
+    std::string imagesDir = "./assets/images/";
+    // Sprites are drawn this many times their size, like the map tiles.
+    float unitScale = 2.0f;
+};
+
+// Fills the map with units moving around and keeps killing and spawning
+// them, to reproduce production-like load on any machine.
+class StressScenario {
+    private:
+        enum UnitType {
+            UNIT_TANK,
+            UNIT_TRUCK,
+            UNIT_CHOPPER,
+            UNIT_BULLET,
+        };
+
+        struct Unit {
+            Entity entity;
+            UnitType type;
+        };
+
+        StressScenarioConfig m_config;
+        std::mt19937 m_rng;
+        std::vector<Unit> m_units;
+        glm::vec2 m_worldSize;
+        // Units that should have been respawned but haven't yet because
+        // the churn of a single frame is usually a fraction of a unit.
+        float m_pendingChurn = 0.0f;
+
+        // Queued by QueueAssets, indexed by direction (up, right, down, left).
+        TextureHandle m_pantherTextures[4] = {};
+        TextureHandle m_tigerTextures[4] = {};
+        TextureHandle m_truckTextures[4] = {};
+        TextureHandle m_chopperTexture = 0;
+        TextureHandle m_bulletTexture = 0;
+
+        Entity SpawnUnit(Registry& registry, UnitType type);
+
+    public:
+        StressScenario(const StressScenarioConfig& config);
+        // Queues the textures, which have to be loaded by
+        // AssetStore::LoadQueued before Setup.
+        void QueueAssets(AssetStore& assetStore);
+        // Spawns the units anywhere in the worldSize pixels of the level,
+        // they wrap around at its edges.
+        void Setup(Registry& registry, glm::vec2 worldSize);
+        void Update(Registry& registry, float deltaT);
+        size_t GetNumUnits() const { return m_units.size(); }
+};
+
+#endif
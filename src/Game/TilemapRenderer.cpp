@@ -0,0 +1,372 @@
+#include "TilemapRenderer.h"
+#include "../Logger/Logger.h"
+#include "../Profiler/Profiler.h"
+#include <algorithm>
+#include <cmath>
+
+TilemapRenderer::TilemapRenderer()
+    : m_tilemap(nullptr), m_tileset(0), m_tileSize(0), m_scale(1.0f),
+      m_numChunkCols(0), m_numChunkRows(0), m_memoryBudget(256 << 20), m_memoryUsed(0), m_frame(0),
+      m_useTargets(false), m_synchronous(false), m_warnedOverBudget(false), m_numChunksDrawn(0), m_stopLoader(false) {
+}
+
+TilemapRenderer::~TilemapRenderer() {
+    Destroy();
+}
+
+void TilemapRenderer::Initialize(SDL_Renderer* renderer, const Tilemap* tilemap, TextureHandle tileset, int tileSize, float scale) {
+    Destroy();
+    m_tilemap = tilemap;
+    m_tileset = tileset;
+    m_tileSize = tileSize;
+    m_scale = scale;
+    m_numChunkCols = (tilemap->GetNumCols() + CHUNK_TILES - 1) / CHUNK_TILES;
+    m_numChunkRows = (tilemap->GetNumRows() + CHUNK_TILES - 1) / CHUNK_TILES;
+    m_chunks.assign(size_t(m_numChunkCols) * m_numChunkRows, Chunk());
+    m_useTargets = SDL_RenderTargetSupported(renderer) == SDL_TRUE;
+    if (!m_useTargets) {
+        Logger::Log("The renderer has no render targets, drawing the tilemap tile by tile");
+    }
+    if (!m_chunks.empty() && !m_synchronous) {
+        m_stopLoader = false;
+        m_loaderThread = std::thread(&TilemapRenderer::LoaderMain, this);
+    }
+}
+
+void TilemapRenderer::SetChunkCallbacks(ChunkCallback onLoaded, ChunkCallback onEvicted) {
+    m_onChunkLoaded = std::move(onLoaded);
+    m_onChunkEvicted = std::move(onEvicted);
+}
+
+void TilemapRenderer::Invalidate() {
+    for (int index : m_residentChunks) {
+        Chunk& chunk = m_chunks[index];
+        if (chunk.texture) {
+            m_memoryUsed -= GetChunkMemory(chunk);
+            SDL_DestroyTexture(chunk.texture);
+            chunk.texture = nullptr;
+            m_memoryUsed += GetChunkMemory(chunk);
+        }
+    }
+}
+
+void TilemapRenderer::Destroy() {
+    StopLoader();
+    // Copy, Unload takes the chunk off the list.
+    const std::vector<int> residentChunks = m_residentChunks;
+    for (int index : residentChunks) {
+        Unload(index);
+    }
+    m_chunks.clear();
+    m_tilemap = nullptr;
+    m_numChunkCols = 0;
+    m_numChunkRows = 0;
+    m_memoryUsed = 0;
+    m_warnedOverBudget = false;
+}
+
+void TilemapRenderer::StopLoader() {
+    if (!m_loaderThread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_loaderMutex);
+        m_stopLoader = true;
+    }
+    m_loaderWakeUp.notify_one();
+    m_loaderThread.join();
+    // Whatever it loaded isn't resident yet, no callbacks for it.
+    m_loadRequests.clear();
+    m_loadedChunks.clear();
+}
+
+void TilemapRenderer::LoaderMain() {
+    std::unique_lock<std::mutex> lock(m_loaderMutex);
+    while (true) {
+        m_loaderWakeUp.wait(lock, [this]() { return m_stopLoader || !m_loadRequests.empty(); });
+        if (m_stopLoader) {
+            return;
+        }
+        const int index = m_loadRequests.front();
+        m_loadRequests.pop_front();
+        lock.unlock();
+        LoadedChunk loaded;
+        loaded.index = index;
+        {
+            PROFILE_SCOPE("TilemapRenderer::LoadChunk");
+            loaded.tiles = CopyTiles(GetChunkTiles(index));
+        }
+        lock.lock();
+        m_loadedChunks.push_back(std::move(loaded));
+    }
+}
+
+std::vector<uint16_t> TilemapRenderer::CopyTiles(const SDL_Rect& tiles) const {
+    // For a mapped .tmb file this is where its pages get read in.
+    std::vector<uint16_t> copy(size_t(tiles.w) * tiles.h);
+    const uint16_t* source = m_tilemap->GetTiles();
+    for (int row = 0; row < tiles.h; row++) {
+        const uint16_t* sourceRow = source + size_t(tiles.y + row) * m_tilemap->GetNumCols() + tiles.x;
+        std::copy(sourceRow, sourceRow + tiles.w, copy.begin() + size_t(row) * tiles.w);
+    }
+    return copy;
+}
+
+size_t TilemapRenderer::GetChunkMemory(const Chunk& chunk) const {
+    size_t bytes = chunk.tiles.capacity() * sizeof(uint16_t);
+    if (chunk.texture) {
+        // Baked at the tileset's resolution, 4 bytes a pixel.
+        const size_t chunkPixels = size_t(CHUNK_TILES) * m_tileSize;
+        bytes += chunkPixels * chunkPixels * 4;
+    }
+    return bytes;
+}
+
+SDL_Rect TilemapRenderer::GetChunkTiles(int index) const {
+    const int chunkCol = index % m_numChunkCols;
+    const int chunkRow = index / m_numChunkCols;
+    SDL_Rect tiles = {chunkCol * CHUNK_TILES, chunkRow * CHUNK_TILES, CHUNK_TILES, CHUNK_TILES};
+    tiles.w = std::min(tiles.w, m_tilemap->GetNumCols() - tiles.x);
+    tiles.h = std::min(tiles.h, m_tilemap->GetNumRows() - tiles.y);
+    return tiles;
+}
+
+SDL_Rect TilemapRenderer::GetChunkRange(const SDL_Rect& camera, int margin) const {
+    const float chunkSize = CHUNK_TILES * m_tileSize * m_scale;
+    const int firstCol = std::max(int(std::floor(camera.x / chunkSize)) - margin, 0);
+    const int firstRow = std::max(int(std::floor(camera.y / chunkSize)) - margin, 0);
+    const int lastCol = std::min(int(std::floor((camera.x + camera.w - 1) / chunkSize)) + margin, m_numChunkCols - 1);
+    const int lastRow = std::min(int(std::floor((camera.y + camera.h - 1) / chunkSize)) + margin, m_numChunkRows - 1);
+    return {firstCol, firstRow, lastCol - firstCol + 1, lastRow - firstRow + 1};
+}
+
+void TilemapRenderer::RequestChunks(const SDL_Rect& chunkRange) {
+    if (m_synchronous) {
+        for (int chunkRow = chunkRange.y; chunkRow < chunkRange.y + chunkRange.h; chunkRow++) {
+            for (int chunkCol = chunkRange.x; chunkCol < chunkRange.x + chunkRange.w; chunkCol++) {
+                const int index = chunkRow * m_numChunkCols + chunkCol;
+                m_chunks[index].lastUsedFrame = m_frame;
+                if (m_chunks[index].state == CHUNK_UNLOADED) {
+                    FinishLoad(index, CopyTiles(GetChunkTiles(index)));
+                }
+            }
+        }
+        return;
+    }
+    bool requested = false;
+    {
+        std::lock_guard<std::mutex> lock(m_loaderMutex);
+        for (int chunkRow = chunkRange.y; chunkRow < chunkRange.y + chunkRange.h; chunkRow++) {
+            for (int chunkCol = chunkRange.x; chunkCol < chunkRange.x + chunkRange.w; chunkCol++) {
+                const int index = chunkRow * m_numChunkCols + chunkCol;
+                Chunk& chunk = m_chunks[index];
+                chunk.lastUsedFrame = m_frame;
+                if (chunk.state == CHUNK_UNLOADED) {
+                    chunk.state = CHUNK_LOADING;
+                    m_loadRequests.push_back(index);
+                    requested = true;
+                }
+            }
+        }
+    }
+    if (requested) {
+        m_loaderWakeUp.notify_one();
+    }
+}
+
+void TilemapRenderer::FinishLoads() {
+    std::vector<LoadedChunk> loadedChunks;
+    {
+        std::lock_guard<std::mutex> lock(m_loaderMutex);
+        loadedChunks.swap(m_loadedChunks);
+    }
+    for (LoadedChunk& loaded : loadedChunks) {
+        // Evicted again while loading.
+        if (m_chunks[loaded.index].state == CHUNK_LOADING) {
+            FinishLoad(loaded.index, std::move(loaded.tiles));
+        }
+    }
+}
+
+void TilemapRenderer::FinishLoad(int index, std::vector<uint16_t>&& tiles) {
+    Chunk& chunk = m_chunks[index];
+    chunk.tiles = std::move(tiles);
+    chunk.state = CHUNK_LOADED;
+    m_residentChunks.push_back(index);
+    m_memoryUsed += GetChunkMemory(chunk);
+    if (m_onChunkLoaded) {
+        m_onChunkLoaded(index, GetChunkTiles(index));
+    }
+}
+
+void TilemapRenderer::Unload(int index) {
+    Chunk& chunk = m_chunks[index];
+    if (chunk.state == CHUNK_LOADED && m_onChunkEvicted) {
+        m_onChunkEvicted(index, GetChunkTiles(index));
+    }
+    m_memoryUsed -= GetChunkMemory(chunk);
+    if (chunk.texture) {
+        SDL_DestroyTexture(chunk.texture);
+    }
+    chunk = Chunk();
+    m_residentChunks.erase(std::find(m_residentChunks.begin(), m_residentChunks.end(), index));
+}
+
+void TilemapRenderer::EvictChunks() {
+    if (m_memoryUsed <= m_memoryBudget) {
+        return;
+    }
+    PROFILE_SCOPE("TilemapRenderer::EvictChunks");
+    // Least recently seen first.
+    std::vector<int> candidates = m_residentChunks;
+    std::sort(candidates.begin(), candidates.end(), [this](int a, int b) {
+        return m_chunks[a].lastUsedFrame < m_chunks[b].lastUsedFrame;
+    });
+    int numEvicted = 0;
+    for (int index : candidates) {
+        // The rest were requested this frame, visible or prefetched.
+        // Evicting them would only load them again next frame.
+        if (m_memoryUsed <= m_memoryBudget || m_chunks[index].lastUsedFrame == m_frame) {
+            break;
+        }
+        Unload(index);
+        numEvicted++;
+    }
+    if (numEvicted > 0) {
+        LOG_DEBUG(Logger::CATEGORY_GAME, "Evicted {} map chunks, {} still loaded ({} KB)", numEvicted, m_residentChunks.size(), m_memoryUsed >> 10);
+    }
+    if (m_memoryUsed > m_memoryBudget && !m_warnedOverBudget) {
+        m_warnedOverBudget = true;
+        LOG_WARN(
+            Logger::CATEGORY_GAME, "The map chunks around the camera need {} KB, more than the budget of {} KB",
+            m_memoryUsed >> 10, m_memoryBudget >> 10
+        );
+    }
+}
+
+void TilemapRenderer::DrawTiles(SDL_Renderer* renderer, const AssetStore& assetStore, const std::vector<uint16_t>& tiles, int tilesWidth, const SDL_Rect& tileRect, SDL_Point origin, float scale) const {
+    const TextureRegion* tileset = assetStore.GetTextureRegion(m_tileset);
+    if (!tileset) {
+        return;
+    }
+    const int tilesetCols = std::max(tileset->rect.w / m_tileSize, 1);
+    const int numTiles = tilesetCols * (tileset->rect.h / m_tileSize);
+    const float size = m_tileSize * scale;
+    for (int row = tileRect.y; row < tileRect.y + tileRect.h; row++) {
+        for (int col = tileRect.x; col < tileRect.x + tileRect.w; col++) {
+            const int tile = tiles[size_t(row) * tilesWidth + col];
+            if (tile >= numTiles) {
+                continue;
+            }
+            const SDL_Rect srcRect = {
+                tileset->rect.x + tile % tilesetCols * m_tileSize,
+                tileset->rect.y + tile / tilesetCols * m_tileSize,
+                m_tileSize,
+                m_tileSize
+            };
+            // Rounding both edges keeps neighbouring tiles from leaving
+            // gaps at fractional scales.
+            const int left = origin.x + int(std::lround((col - tileRect.x) * size));
+            const int top = origin.y + int(std::lround((row - tileRect.y) * size));
+            const SDL_Rect dstRect = {
+                left,
+                top,
+                origin.x + int(std::lround((col - tileRect.x + 1) * size)) - left,
+                origin.y + int(std::lround((row - tileRect.y + 1) * size)) - top
+            };
+            SDL_RenderCopy(renderer, tileset->texture, &srcRect, &dstRect);
+        }
+    }
+}
+
+SDL_Texture* TilemapRenderer::BakeChunk(SDL_Renderer* renderer, const AssetStore& assetStore, const Chunk& chunk, const SDL_Rect& tiles) const {
+    PROFILE_SCOPE("TilemapRenderer::BakeChunk");
+    // Baked at the tileset's resolution, scaled when drawn.
+    SDL_Texture* texture = SDL_CreateTexture(
+        renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET,
+        tiles.w * m_tileSize, tiles.h * m_tileSize
+    );
+    if (!texture) {
+        return nullptr;
+    }
+    SDL_Texture* previousTarget = SDL_GetRenderTarget(renderer);
+    if (SDL_SetRenderTarget(renderer, texture) != 0) {
+        SDL_DestroyTexture(texture);
+        return nullptr;
+    }
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+    SDL_RenderClear(renderer);
+    DrawTiles(renderer, assetStore, chunk.tiles, tiles.w, {0, 0, tiles.w, tiles.h}, {0, 0}, 1.0f);
+    SDL_SetRenderTarget(renderer, previousTarget);
+    return texture;
+}
+
+void TilemapRenderer::Render(SDL_Renderer* renderer, const AssetStore& assetStore, const SDL_Rect& camera) {
+    PROFILE_SCOPE("TilemapRenderer::Render");
+    m_numChunksDrawn = 0;
+    if (!m_tilemap || m_chunks.empty()) {
+        return;
+    }
+    m_frame++;
+    FinishLoads();
+    const SDL_Rect visibleChunks = GetChunkRange(camera, 0);
+    RequestChunks(GetChunkRange(camera, PREFETCH_CHUNKS));
+
+    const float chunkSize = CHUNK_TILES * m_tileSize * m_scale;
+    for (int chunkRow = visibleChunks.y; chunkRow < visibleChunks.y + visibleChunks.h; chunkRow++) {
+        for (int chunkCol = visibleChunks.x; chunkCol < visibleChunks.x + visibleChunks.w; chunkCol++) {
+            const int index = chunkRow * m_numChunkCols + chunkCol;
+            Chunk& chunk = m_chunks[index];
+            const SDL_Rect tiles = GetChunkTiles(index);
+            if (chunk.state != CHUNK_LOADED) {
+                // The camera outran the loader (or this is the first frame),
+                // a hole in the map would be worse than the hitch. A copy the
+                // loader already started gets dropped when it arrives.
+                PROFILE_SCOPE("TilemapRenderer::LoadChunkNow");
+                {
+                    std::lock_guard<std::mutex> lock(m_loaderMutex);
+                    auto request = std::find(m_loadRequests.begin(), m_loadRequests.end(), index);
+                    if (request != m_loadRequests.end()) {
+                        m_loadRequests.erase(request);
+                    }
+                }
+                FinishLoad(index, CopyTiles(tiles));
+            }
+            if (!chunk.texture && m_useTargets) {
+                m_memoryUsed -= GetChunkMemory(chunk);
+                chunk.texture = BakeChunk(renderer, assetStore, chunk, tiles);
+                m_memoryUsed += GetChunkMemory(chunk);
+            }
+
+            const SDL_Point origin = {
+                int(std::lround(chunkCol * chunkSize)) - camera.x,
+                int(std::lround(chunkRow * chunkSize)) - camera.y
+            };
+            if (chunk.texture) {
+                const SDL_Rect dstRect = {
+                    origin.x,
+                    origin.y,
+                    int(std::lround(tiles.w * m_tileSize * m_scale)),
+                    int(std::lround(tiles.h * m_tileSize * m_scale))
+                };
+                SDL_RenderCopy(renderer, chunk.texture, nullptr, &dstRect);
+            } else {
+                // Only the part of the chunk that is on screen.
+                const float tileSize = m_tileSize * m_scale;
+                SDL_Rect visible;
+                visible.x = std::max(0, int(std::floor(camera.x / tileSize)) - tiles.x);
+                visible.y = std::max(0, int(std::floor(camera.y / tileSize)) - tiles.y);
+                visible.w = std::min(tiles.w, int(std::ceil((camera.x + camera.w) / tileSize)) - tiles.x) - visible.x;
+                visible.h = std::min(tiles.h, int(std::ceil((camera.y + camera.h) / tileSize)) - tiles.y) - visible.y;
+                const SDL_Point visibleOrigin = {
+                    origin.x + int(std::lround(visible.x * tileSize)),
+                    origin.y + int(std::lround(visible.y * tileSize))
+                };
+                DrawTiles(renderer, assetStore, chunk.tiles, tiles.w, visible, visibleOrigin, m_scale);
+            }
+            m_numChunksDrawn++;
+        }
+    }
+    EvictChunks();
+}
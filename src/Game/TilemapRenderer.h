@@ -0,0 +1,144 @@
+#ifndef TILEMAP_RENDERER_H
+#define TILEMAP_RENDERER_H
+
+#include <SDL2/SDL.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../AssetStore/AssetStore.h"
+#include "../AssetStore/Tilemap.h"
+
+// Draws a tilemap from textures of CHUNK_TILES x CHUNK_TILES tiles each,
+// drawn once from the tileset into a render target, so a frame costs a
+// handful of copies for the chunks the camera sees instead of one per
+// tile.
+//
+// Chunks are streamed, so maps far bigger than memory work: a loader
+// thread copies the tiles of the chunks around the camera out of the
+// tilemap (for a .tmb file that is where they get read from disk) and
+// the render thread bakes them once they come into view. When the
+// loaded chunks take more than the memory budget the least recently
+// seen ones are evicted. The chunk callbacks tell the game when to
+// create and destroy the entities of a chunk.
+//
+// A tile id is the index of the tile in the tileset, counting left to
+// right and top to bottom: with jungle.png's 10 tiles a row, id 21 is
+// the second tile of the third row.
+//
+// Renderers without render target support get the visible tiles drawn
+// one by one every frame instead.
+class TilemapRenderer {
+    public:
+        static const int CHUNK_TILES = 32;
+        // Chunks this far outside the camera get loaded ahead of time.
+        static const int PREFETCH_CHUNKS = 1;
+
+        // Called on the render thread with the chunk's tiles (in tiles).
+        using ChunkCallback = std::function<void(int chunkIndex, const SDL_Rect& tiles)>;
+
+    private:
+        enum ChunkState {
+            CHUNK_UNLOADED,
+            CHUNK_LOADING,
+            CHUNK_LOADED,
+        };
+
+        struct Chunk {
+            ChunkState state = CHUNK_UNLOADED;
+            std::vector<uint16_t> tiles;
+            // nullptr until baked.
+            SDL_Texture* texture = nullptr;
+            uint64_t lastUsedFrame = 0;
+        };
+
+        struct LoadedChunk {
+            int index;
+            std::vector<uint16_t> tiles;
+        };
+
+        const Tilemap* m_tilemap;
+        TextureHandle m_tileset;
+        int m_tileSize;
+        float m_scale;
+        int m_numChunkCols;
+        int m_numChunkRows;
+        // Row by row.
+        std::vector<Chunk> m_chunks;
+        // Indices of the chunks that aren't unloaded.
+        std::vector<int> m_residentChunks;
+        size_t m_memoryBudget;
+        size_t m_memoryUsed;
+        uint64_t m_frame;
+        bool m_useTargets;
+        // Load on the render thread, see SetSynchronous.
+        bool m_synchronous;
+        bool m_warnedOverBudget;
+        int m_numChunksDrawn;
+        ChunkCallback m_onChunkLoaded;
+        ChunkCallback m_onChunkEvicted;
+
+        std::thread m_loaderThread;
+        std::mutex m_loaderMutex;
+        std::condition_variable m_loaderWakeUp;
+        std::deque<int> m_loadRequests;
+        std::vector<LoadedChunk> m_loadedChunks;
+        bool m_stopLoader;
+
+        void LoaderMain();
+        void StopLoader();
+        std::vector<uint16_t> CopyTiles(const SDL_Rect& tiles) const;
+        void RequestChunks(const SDL_Rect& chunkRange);
+        void FinishLoads();
+        void FinishLoad(int index, std::vector<uint16_t>&& tiles);
+        // Evicts the least recently seen chunks until they fit the budget,
+        // but none of the ones requested this frame.
+        void EvictChunks();
+        void Unload(int index);
+        size_t GetChunkMemory(const Chunk& chunk) const;
+
+        // Draws the tiles of tileRect (in tiles, relative to the chunk's
+        // tiles) with its top left corner at origin, scale times their
+        // size.
+        void DrawTiles(SDL_Renderer* renderer, const AssetStore& assetStore, const std::vector<uint16_t>& tiles, int tilesWidth, const SDL_Rect& tileRect, SDL_Point origin, float scale) const;
+        SDL_Texture* BakeChunk(SDL_Renderer* renderer, const AssetStore& assetStore, const Chunk& chunk, const SDL_Rect& tiles) const;
+        // The tiles of the chunk, clipped to the map.
+        SDL_Rect GetChunkTiles(int index) const;
+        // The chunks (in chunks) covering camera grown by margin chunks,
+        // clipped to the map.
+        SDL_Rect GetChunkRange(const SDL_Rect& camera, int margin) const;
+
+    public:
+        TilemapRenderer();
+        ~TilemapRenderer();
+
+        // tilemap has to outlive the renderer or the next Initialize.
+        void Initialize(SDL_Renderer* renderer, const Tilemap* tilemap, TextureHandle tileset, int tileSize, float scale);
+        // Bytes of tiles and chunk textures to keep loaded, the chunks in
+        // view and the ones prefetched around them are kept even if they
+        // need more.
+        void SetMemoryBudget(size_t bytes) { m_memoryBudget = bytes; }
+        void SetChunkCallbacks(ChunkCallback onLoaded, ChunkCallback onEvicted);
+        // Loads chunks on the render thread in the frame they are requested
+        // instead of on the loader thread, so chunks (and whatever the
+        // callbacks spawn for them) arrive on the same frames every run.
+        // Takes effect with the next Initialize.
+        void SetSynchronous(bool synchronous) { m_synchronous = synchronous; }
+        // Drops the baked chunk textures, they get baked again when seen
+        // next.
+        void Invalidate();
+        // Evicts everything, calling the evicted callback for each chunk.
+        void Destroy();
+
+        // camera is the part of the world (in pixels) the screen shows.
+        void Render(SDL_Renderer* renderer, const AssetStore& assetStore, const SDL_Rect& camera);
+
+        int GetNumChunksDrawn() const { return m_numChunksDrawn; }
+        size_t GetNumChunksResident() const { return m_residentChunks.size(); }
+        size_t GetMemoryUsed() const { return m_memoryUsed; }
+};
+
+#endif
@@ -0,0 +1,212 @@
+#include "FlightRecorder.h"
+#include "Logger.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define FLIGHT_RECORDER_MMAP
+#endif
+
+namespace FlightRecorder {
+    static const char MAGIC[8] = {'2', 'D', 'G', 'E', 'F', 'L', 'T', '1'};
+    static const uint32_t VERSION = 1;
+
+    // File layout: this header, then the frame, scope and log rings at
+    // the offsets it lists. Everything is in the host's byte order.
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t processId;
+        int64_t sessionStartUs;
+        uint64_t frameOffset;
+        uint64_t frameCapacity;
+        uint64_t scopeOffset;
+        uint64_t scopeCapacity;
+        uint64_t logOffset;
+        uint64_t logCapacity;
+    };
+
+    static const uint64_t FRAME_OFFSET = 4096;
+    static const uint64_t SCOPE_OFFSET = FRAME_OFFSET + FRAME_CAPACITY * sizeof(FrameRecord);
+    static const uint64_t LOG_OFFSET = SCOPE_OFFSET + SCOPE_CAPACITY * sizeof(ScopeRecord);
+    static const uint64_t FILE_SIZE = LOG_OFFSET + LOG_CAPACITY * sizeof(LogRecord);
+
+    // The mapping is never unmapped: other threads may still be writing
+    // a record when Close runs, it goes away with the process.
+    static uint8_t* mapping = nullptr;
+    static std::atomic<FrameRecord*> frames(nullptr);
+    static std::atomic<ScopeRecord*> scopes(nullptr);
+    static std::atomic<LogRecord*> logs(nullptr);
+    // Next sequence of each ring, minus one. Sequences start at 1.
+    static std::atomic<uint64_t> frameHead(0);
+    static std::atomic<uint64_t> scopeHead(0);
+    static std::atomic<uint64_t> logHead(0);
+
+    static int64_t NowUs() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()
+        ).count();
+    }
+
+    // Invalidates the slot, fills it and then publishes the sequence, so
+    // a slot caught mid-write reads as empty.
+    template <typename TRecord, typename TFill>
+    static void Append(TRecord* ring, uint64_t capacity, std::atomic<uint64_t>& head, TFill&& fill) {
+        const uint64_t sequence = head.fetch_add(1, std::memory_order_relaxed) + 1;
+        TRecord& record = ring[(sequence - 1) % capacity];
+        __atomic_store_n(&record.sequence, 0, __ATOMIC_RELAXED);
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        fill(record);
+        __atomic_store_n(&record.sequence, sequence, __ATOMIC_RELEASE);
+    }
+
+    bool Open(const std::string& path) {
+#ifdef FLIGHT_RECORDER_MMAP
+        if (mapping) {
+            Logger::Err("The flight recorder is already open");
+            return false;
+        }
+        const int fileDescriptor = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fileDescriptor < 0 || ftruncate(fileDescriptor, FILE_SIZE) != 0) {
+            Logger::Err("Could not create the flight recorder file " + path);
+            if (fileDescriptor >= 0) {
+                close(fileDescriptor);
+            }
+            return false;
+        }
+        void* address = mmap(nullptr, FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+        // The mapping keeps the file alive.
+        close(fileDescriptor);
+        if (address == MAP_FAILED) {
+            Logger::Err("Could not map the flight recorder file " + path);
+            return false;
+        }
+        mapping = static_cast<uint8_t*>(address);
+
+        FileHeader header = {};
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.processId = uint32_t(getpid());
+        header.sessionStartUs = NowUs();
+        header.frameOffset = FRAME_OFFSET;
+        header.frameCapacity = FRAME_CAPACITY;
+        header.scopeOffset = SCOPE_OFFSET;
+        header.scopeCapacity = SCOPE_CAPACITY;
+        header.logOffset = LOG_OFFSET;
+        header.logCapacity = LOG_CAPACITY;
+        memcpy(mapping, &header, sizeof(header));
+
+        frames.store(reinterpret_cast<FrameRecord*>(mapping + FRAME_OFFSET), std::memory_order_release);
+        scopes.store(reinterpret_cast<ScopeRecord*>(mapping + SCOPE_OFFSET), std::memory_order_release);
+        logs.store(reinterpret_cast<LogRecord*>(mapping + LOG_OFFSET), std::memory_order_release);
+        Logger::Log("Flight recorder writing to " + path);
+        return true;
+#else
+        Logger::Err("The flight recorder needs mmap, which this platform doesn't have");
+        return false;
+#endif
+    }
+
+    void Close() {
+        frames.store(nullptr, std::memory_order_relaxed);
+        scopes.store(nullptr, std::memory_order_relaxed);
+        logs.store(nullptr, std::memory_order_relaxed);
+    }
+
+    bool IsOpen() {
+        return frames.load(std::memory_order_relaxed) != nullptr;
+    }
+
+    void RecordFrame(const FrameRecord& frame) {
+        FrameRecord* ring = frames.load(std::memory_order_acquire);
+        if (!ring) {
+            return;
+        }
+        Append(ring, FRAME_CAPACITY, frameHead, [&](FrameRecord& record) {
+            record.timestampUs = NowUs();
+            record.frameMs = frame.frameMs;
+            record.updateMs = frame.updateMs;
+            record.renderMs = frame.renderMs;
+            record.presentMs = frame.presentMs;
+            record.allocations = frame.allocations;
+            record.numEntities = frame.numEntities;
+        });
+    }
+
+    void RecordScope(const char* name, uint64_t beginNs, uint64_t endNs, uint32_t threadIndex) {
+        ScopeRecord* ring = scopes.load(std::memory_order_acquire);
+        if (!ring) {
+            return;
+        }
+        Append(ring, SCOPE_CAPACITY, scopeHead, [&](ScopeRecord& record) {
+            record.beginNs = beginNs;
+            record.endNs = endNs;
+            record.threadIndex = threadIndex;
+            strncpy(record.name, name, sizeof(record.name) - 1);
+            record.name[sizeof(record.name) - 1] = '\0';
+        });
+    }
+
+    void RecordLog(uint8_t level, int64_t timestampUs, const char* text, size_t length) {
+        LogRecord* ring = logs.load(std::memory_order_acquire);
+        if (!ring) {
+            return;
+        }
+        Append(ring, LOG_CAPACITY, logHead, [&](LogRecord& record) {
+            record.timestampUs = timestampUs;
+            record.level = level;
+            record.length = uint16_t(std::min(length, sizeof(record.text)));
+            memcpy(record.text, text, record.length);
+        });
+    }
+
+    template <typename TRecord>
+    static bool ReadRing(FILE* file, uint64_t offset, uint64_t capacity, std::vector<TRecord>& out) {
+        std::vector<TRecord> ring(capacity);
+        if (fseek(file, long(offset), SEEK_SET) != 0 ||
+            fread(ring.data(), sizeof(TRecord), capacity, file) != capacity) {
+            return false;
+        }
+        for (const TRecord& record : ring) {
+            if (record.sequence != 0) {
+                out.push_back(record);
+            }
+        }
+        std::sort(out.begin(), out.end(), [](const TRecord& a, const TRecord& b) {
+            return a.sequence < b.sequence;
+        });
+        return true;
+    }
+
+    bool Read(const std::string& path, Recording& recording) {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) {
+            fprintf(stderr, "Could not open %s\n", path.c_str());
+            return false;
+        }
+        FileHeader header;
+        bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+            memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+            header.version == VERSION &&
+            header.frameCapacity == FRAME_CAPACITY &&
+            header.scopeCapacity == SCOPE_CAPACITY &&
+            header.logCapacity == LOG_CAPACITY;
+        if (ok) {
+            recording.sessionStartUs = header.sessionStartUs;
+            recording.processId = header.processId;
+            ok = ReadRing(file, header.frameOffset, header.frameCapacity, recording.frames) &&
+                ReadRing(file, header.scopeOffset, header.scopeCapacity, recording.scopes) &&
+                ReadRing(file, header.logOffset, header.logCapacity, recording.logs);
+        }
+        fclose(file);
+        if (!ok) {
+            fprintf(stderr, "%s is not a flight recording from this build\n", path.c_str());
+        }
+        return ok;
+    }
+}
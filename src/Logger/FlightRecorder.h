@@ -0,0 +1,73 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Keeps the last few seconds of frame timings, profiler scopes and log
+// messages in rings inside a memory-mapped file. Records are plain
+// stores into the shared mapping, so the kernel has them even if the
+// process crashes a moment later and nothing ever needs flushing. Read a
+// recording back with Read, or with the 2dge_flightdump tool.
+//
+// Each record starts with a sequence number, written last, so a reader
+// can put the rings back in order and skip slots that were being written
+// when the process died. 0 marks a slot that was never written.
+namespace FlightRecorder {
+    static const uint64_t FRAME_CAPACITY = 2048;
+    static const uint64_t SCOPE_CAPACITY = 32768;
+    static const uint64_t LOG_CAPACITY = 2048;
+
+    struct FrameRecord {
+        uint64_t sequence;
+        int64_t timestampUs;
+        float frameMs;
+        float updateMs;
+        float renderMs;
+        float presentMs;
+        uint32_t allocations;
+        uint32_t numEntities;
+    };
+
+    struct ScopeRecord {
+        uint64_t sequence;
+        uint64_t beginNs;
+        uint64_t endNs;
+        uint32_t threadIndex;
+        char name[36];
+    };
+
+    struct LogRecord {
+        uint64_t sequence;
+        int64_t timestampUs;
+        uint8_t level;
+        uint8_t unused;
+        uint16_t length;
+        char text[236];
+    };
+
+    // Creates (or truncates) the file at path and starts recording.
+    bool Open(const std::string& path);
+    void Close();
+    bool IsOpen();
+
+    // Fills in the sequence and timestamp itself.
+    void RecordFrame(const FrameRecord& frame);
+    // Safe to call from any thread.
+    void RecordScope(const char* name, uint64_t beginNs, uint64_t endNs, uint32_t threadIndex);
+    void RecordLog(uint8_t level, int64_t timestampUs, const char* text, size_t length);
+
+    // A recording read back from disk, every ring oldest first.
+    struct Recording {
+        int64_t sessionStartUs = 0;
+        uint32_t processId = 0;
+        std::vector<FrameRecord> frames;
+        std::vector<ScopeRecord> scopes;
+        std::vector<LogRecord> logs;
+    };
+
+    bool Read(const std::string& path, Recording& recording);
+}
+
+#endif
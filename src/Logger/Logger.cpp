@@ -1,31 +1,476 @@
 #include "Logger.h"
-#include <iostream>
+#include "FlightRecorder.h"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <mutex>
+#include <thread>
 #include <vector>
 
-using namespace std;
+namespace Logger {
+    // Slots in the ring, a power of two.
+    static const uint64_t RING_CAPACITY = 1 << 13;
+    // How long the writer sleeps when there is nothing to write.
+    static const auto WRITER_IDLE_WAIT = std::chrono::milliseconds(2);
+    static const size_t MAX_FORMATS = 4096;
+    // Bytes of a record in front of its arguments.
+    static const size_t RECORD_HEADER_SIZE = offsetof(LogRecord, args);
+    static const char DUMP_MAGIC[8] = {'2', 'D', 'G', 'E', 'L', 'O', 'G', '1'};
 
-std::string CurrentDateTimeToString() {
-    // This should be displayed in green and wiot
-    time_t now = chrono::system_clock::to_time_t(chrono::system_clock::now());
-    string output(30, '\0');
-    strftime(&output[0], output.size(), "%Y-%b-%d %H:%M:%S", std::localtime(&now));
-    return output;
-}
+    // A slot is free for the producer claiming position p when its
+    // sequence is p and holds a record for the consumer once it is p + 1.
+    struct Slot {
+        std::atomic<uint64_t> sequence;
+        LogRecord record;
+    };
 
-namespace Logger {
-    static std::vector<LogEntry> logs;
-
-   void Log(const std::string& msg) {
-       logs.push_back({.type = LOG_INFO, .msg = msg});
-       std::string output = "LOG: [" + CurrentDateTimeToString() + "]: " + msg;
-       cout << "\x1B[32m" << output << "\033[0m" << endl;
-   }
-
-   void Err(const std::string& msg) {
-       logs.push_back({.type = LOG_ERROR, .msg = msg});
-       std::string output = "LOG: [" + CurrentDateTimeToString() + "]: " + msg;
-       cout << "\x1B[91m" << output << "\033[0m" << endl;
-   }
-}
\ No newline at end of file
+    // Bounded multi producer, single consumer ring. Producers claim a
+    // position with a CAS on enqueuePos, fill the slot in place and
+    // publish it through the slot's sequence, so they never wait on each
+    // other or on the writer.
+    struct RingBuffer {
+        std::vector<Slot> slots;
+        alignas(64) std::atomic<uint64_t> enqueuePos;
+        // Only touched by the writer thread.
+        alignas(64) uint64_t dequeuePos;
+        // Records the writer has finished writing, Flush waits on it.
+        std::atomic<uint64_t> writtenPos;
+        std::atomic<uint64_t> dropped;
+
+        RingBuffer() : slots(RING_CAPACITY), enqueuePos(0), dequeuePos(0), writtenPos(0), dropped(0) {
+            for (uint64_t i = 0; i < RING_CAPACITY; i++) {
+                slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        bool TryPush(const LogRecord& record) {
+            uint64_t pos = enqueuePos.load(std::memory_order_relaxed);
+            Slot* slot;
+            while (true) {
+                slot = &slots[pos & (RING_CAPACITY - 1)];
+                const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+                const int64_t diff = int64_t(sequence) - int64_t(pos);
+                if (diff == 0) {
+                    if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    // The writer hasn't freed this slot yet: full.
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                } else {
+                    pos = enqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+            // Only the used part of the arguments is copied.
+            memcpy(&slot->record, &record, RECORD_HEADER_SIZE + record.argsSize);
+            slot->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Hands the published records to consume in order, returns how
+        // many there were.
+        template <typename TConsume>
+        size_t Drain(TConsume&& consume) {
+            size_t count = 0;
+            while (true) {
+                Slot& slot = slots[dequeuePos & (RING_CAPACITY - 1)];
+                if (slot.sequence.load(std::memory_order_acquire) != dequeuePos + 1) {
+                    return count;
+                }
+                consume(slot.record);
+                slot.sequence.store(dequeuePos + RING_CAPACITY, std::memory_order_release);
+                dequeuePos++;
+                count++;
+            }
+        }
+    };
+
+    std::atomic<int> runtimeLevel(LEVEL_INFO);
+    std::atomic<uint32_t> runtimeCategories(CATEGORY_ALL);
+
+    static const char* const LEVEL_NAMES[] = {"trace", "debug", "info", "warn", "error"};
+    // Line prefix and terminal color of each level.
+    static const char* const LEVEL_PREFIXES[] = {"TRC: [", "DBG: [", "LOG: [", "WRN: [", "ERR: ["};
+    static const char* const LEVEL_COLORS[] = {"\x1B[90m", "\x1B[36m", "\x1B[32m", "\x1B[93m", "\x1B[91m"};
+
+    static RingBuffer* ring = nullptr;
+    static std::once_flag startOnce;
+    static std::thread writerThread;
+    static std::mutex writerMutex;
+    static std::condition_variable writerWakeup;
+    static std::atomic<bool> stopWriter(false);
+    // Set once the writer has been shut down at exit, later messages are
+    // written synchronously.
+    static std::atomic<bool> writerStopped(false);
+    static std::atomic<FILE*> output(stdout);
+
+    // Registered format strings, indexed by id. Slots are only written
+    // under formatsMutex and published by bumping numFormats.
+    static std::mutex formatsMutex;
+    // Id 0 is reserved for plain Log/Err messages, a single string
+    // argument. It is there before any static initializer can log.
+    static const uint16_t STRING_FORMAT_ID = 0;
+    static std::atomic<const char*> formats[MAX_FORMATS] = {"{}"};
+    static std::atomic<size_t> numFormats(1);
+
+    // Ring of the latest records, overwritten in place so its size never
+    // changes. Appended to by whoever writes, read by CopyHistory.
+    static std::mutex historyMutex;
+    static std::vector<LogRecord> history(HISTORY_CAPACITY);
+    static uint64_t historyHead = 0;
+
+    // Only touched by whoever writes: the writer thread or, after it
+    // stopped, the logging thread.
+    static std::string batch;
+    // The records of the batch, appended to the history once it is
+    // formatted so CopyHistory only waits for the copy.
+    static std::vector<LogRecord> batchRecords;
+    // One message expanded for the flight recorder.
+    static std::string flightMessage;
+    static int64_t cachedSecond = -1;
+    static char cachedDateTime[32];
+
+    int64_t NowUs() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()
+        ).count();
+    }
+
+    uint16_t RegisterFormat(const char* format) {
+        std::lock_guard<std::mutex> lock(formatsMutex);
+        const size_t id = numFormats.load(std::memory_order_relaxed);
+        if (id == MAX_FORMATS) {
+            // Out of ids, the arguments still get printed.
+            return STRING_FORMAT_ID;
+        }
+        formats[id].store(format, std::memory_order_relaxed);
+        numFormats.store(id + 1, std::memory_order_release);
+        return uint16_t(id);
+    }
+
+    static const char* FormatString(uint16_t formatId) {
+        if (formatId >= numFormats.load(std::memory_order_acquire)) {
+            return "<unknown format> {} {} {} {} {} {} {} {}";
+        }
+        return formats[formatId].load(std::memory_order_relaxed);
+    }
+
+    static void AppendArg(const LogRecord& record, size_t& offset, std::string& out) {
+        if (offset >= record.argsSize) {
+            out += "{}";
+            return;
+        }
+        const uint8_t tag = record.args[offset++];
+        const uint8_t* value = record.args + offset;
+        char number[32];
+        switch (tag) {
+            case ARG_INT: {
+                int64_t packed;
+                memcpy(&packed, value, sizeof(packed));
+                out += std::to_string(packed);
+                offset += sizeof(packed);
+            } break;
+            case ARG_UINT: {
+                uint64_t packed;
+                memcpy(&packed, value, sizeof(packed));
+                out += std::to_string(packed);
+                offset += sizeof(packed);
+            } break;
+            case ARG_DOUBLE: {
+                double packed;
+                memcpy(&packed, value, sizeof(packed));
+                snprintf(number, sizeof(number), "%g", packed);
+                out += number;
+                offset += sizeof(packed);
+            } break;
+            case ARG_STRING:
+                out.append(reinterpret_cast<const char*>(value + 1), value[0]);
+                offset += 1 + value[0];
+            break;
+            default:
+                // Corrupt record, stop reading arguments.
+                offset = record.argsSize;
+                out += "<?>";
+        }
+    }
+
+    static void ExpandInto(const char* format, const LogRecord& record, std::string& out) {
+        size_t offset = 0;
+        for (const char* c = format; *c; c++) {
+            if (c[0] == '{' && c[1] == '}') {
+                AppendArg(record, offset, out);
+                c++;
+            } else {
+                out += *c;
+            }
+        }
+    }
+
+    std::string FormatRecord(const LogRecord& record) {
+        std::string message;
+        ExpandInto(FormatString(record.formatId), record, message);
+        return message;
+    }
+
+    // localtime/strftime only run when the second changes.
+    static const char* DateTimeToString(int64_t timestampUs) {
+        const int64_t second = timestampUs / 1000000;
+        if (second != cachedSecond) {
+            const time_t now = time_t(second);
+            tm local;
+            localtime_r(&now, &local);
+            strftime(cachedDateTime, sizeof(cachedDateTime), "%Y-%b-%d %H:%M:%S", &local);
+            cachedSecond = second;
+        }
+        return cachedDateTime;
+    }
+
+    static void AppendToHistory(const LogRecord& record) {
+        memcpy(&history[historyHead % HISTORY_CAPACITY], &record, RECORD_HEADER_SIZE + record.argsSize);
+        historyHead++;
+    }
+
+    static void Format(const LogRecord& record) {
+        if (FlightRecorder::IsOpen()) {
+            flightMessage.clear();
+            ExpandInto(FormatString(record.formatId), record, flightMessage);
+            FlightRecorder::RecordLog(record.level, record.timestampUs, flightMessage.data(), flightMessage.size());
+        }
+        if (!output.load(std::memory_order_relaxed)) {
+            return;
+        }
+        const int level = std::min<int>(record.level, LEVEL_ERROR);
+        batch += LEVEL_COLORS[level];
+        batch += LEVEL_PREFIXES[level];
+        batch += DateTimeToString(record.timestampUs);
+        batch += "]: ";
+        ExpandInto(FormatString(record.formatId), record, batch);
+        batch += "\033[0m\n";
+    }
+
+    static void WriteBatch() {
+        FILE* file = output.load(std::memory_order_relaxed);
+        if (file && !batch.empty()) {
+            fwrite(batch.data(), 1, batch.size(), file);
+            fflush(file);
+        }
+        batch.clear();
+    }
+
+    static void WriterLoop() {
+        uint64_t lastDropped = 0;
+        while (true) {
+            const bool stopping = stopWriter.load(std::memory_order_acquire);
+            const size_t count = ring->Drain([](const LogRecord& record) {
+                Format(record);
+                batchRecords.push_back(record);
+            });
+            if (!batchRecords.empty()) {
+                std::lock_guard<std::mutex> lock(historyMutex);
+                for (const LogRecord& record : batchRecords) {
+                    AppendToHistory(record);
+                }
+            }
+            batchRecords.clear();
+            const uint64_t dropped = ring->dropped.load(std::memory_order_relaxed);
+            if (dropped != lastDropped) {
+                batch += "\x1B[91mLOG: " + std::to_string(dropped - lastDropped) +
+                    " messages dropped, the log ring buffer was full\033[0m\n";
+                lastDropped = dropped;
+            }
+            WriteBatch();
+            ring->writtenPos.fetch_add(count, std::memory_order_release);
+            if (count == 0) {
+                if (stopping) {
+                    return;
+                }
+                std::unique_lock<std::mutex> lock(writerMutex);
+                writerWakeup.wait_for(lock, WRITER_IDLE_WAIT);
+            }
+        }
+    }
+
+    static void StopWriter() {
+        stopWriter.store(true, std::memory_order_release);
+        writerWakeup.notify_one();
+        writerThread.join();
+        writerStopped.store(true, std::memory_order_release);
+    }
+
+    static void StartWriter() {
+        ring = new RingBuffer();
+        writerThread = std::thread(WriterLoop);
+        // Messages still in the ring at exit get written before the
+        // process goes away.
+        std::atexit(StopWriter);
+    }
+
+    void Submit(const LogRecord& record) {
+        std::call_once(startOnce, StartWriter);
+        if (writerStopped.load(std::memory_order_acquire)) {
+            // Static destructors logging after the writer is gone.
+            {
+                std::lock_guard<std::mutex> lock(historyMutex);
+                AppendToHistory(record);
+            }
+            Format(record);
+            WriteBatch();
+            return;
+        }
+        ring->TryPush(record);
+        if (record.level >= LEVEL_ERROR) {
+            // Errors are rare and usually precede an exit, get them out now.
+            writerWakeup.notify_one();
+        }
+    }
+
+    void Log(const std::string& msg) {
+        if (IsEnabled(LEVEL_INFO, CATEGORY_GENERAL)) {
+            Write(LEVEL_INFO, STRING_FORMAT_ID, msg);
+        }
+    }
+
+    void Err(const std::string& msg) {
+        if (IsEnabled(LEVEL_ERROR, CATEGORY_GENERAL)) {
+            Write(LEVEL_ERROR, STRING_FORMAT_ID, msg);
+        }
+    }
+
+    void SetLevel(LogLevel level) {
+        runtimeLevel.store(level, std::memory_order_relaxed);
+    }
+
+    void SetCategories(uint32_t mask) {
+        runtimeCategories.store(mask, std::memory_order_relaxed);
+    }
+
+    bool ParseLevel(const std::string& name, LogLevel& level) {
+        for (int i = LEVEL_TRACE; i <= LEVEL_ERROR; i++) {
+            if (name == LEVEL_NAMES[i]) {
+                level = LogLevel(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Flush() {
+        if (!ring || writerStopped.load(std::memory_order_acquire)) {
+            return;
+        }
+        const uint64_t target = ring->enqueuePos.load(std::memory_order_acquire);
+        writerWakeup.notify_one();
+        // Dropped messages claimed no position, so the writer catches up
+        // with everything that got in.
+        while (ring->writtenPos.load(std::memory_order_acquire) < target) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    void SetOutput(FILE* file) {
+        Flush();
+        output.store(file, std::memory_order_relaxed);
+    }
+
+    uint64_t GetDroppedCount() {
+        return ring ? ring->dropped.load(std::memory_order_relaxed) : 0;
+    }
+
+    void CopyHistory(std::vector<LogRecord>& out, size_t maxCount) {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        const uint64_t count = std::min<uint64_t>({historyHead, HISTORY_CAPACITY, maxCount});
+        for (uint64_t i = historyHead - count; i < historyHead; i++) {
+            out.push_back(history[i % HISTORY_CAPACITY]);
+        }
+    }
+
+    // Dumps are written in the host's byte order:
+    //
+    //     char[8]   "2DGELOG1"
+    //     uint32_t  number of formats, then for each one
+    //                   uint16_t length, the characters
+    //     uint32_t  number of records, then for each one the LogRecord
+    //               header (timestampUs, formatId, level, argsSize)
+    //               followed by its argsSize bytes of arguments
+    bool DumpHistory(const std::string& path) {
+        std::vector<LogRecord> records;
+        Flush();
+        CopyHistory(records);
+
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file) {
+            Err("Could not open log dump " + path);
+            return false;
+        }
+        fwrite(DUMP_MAGIC, 1, sizeof(DUMP_MAGIC), file);
+        const uint32_t formatCount = uint32_t(numFormats.load(std::memory_order_acquire));
+        fwrite(&formatCount, sizeof(formatCount), 1, file);
+        for (uint32_t id = 0; id < formatCount; id++) {
+            const char* format = formats[id].load(std::memory_order_relaxed);
+            const uint16_t length = uint16_t(std::min<size_t>(strlen(format), UINT16_MAX));
+            fwrite(&length, sizeof(length), 1, file);
+            fwrite(format, 1, length, file);
+        }
+        const uint32_t recordCount = uint32_t(records.size());
+        fwrite(&recordCount, sizeof(recordCount), 1, file);
+        for (const LogRecord& record : records) {
+            fwrite(&record, 1, RECORD_HEADER_SIZE + record.argsSize, file);
+        }
+        const bool ok = fclose(file) == 0;
+        Log("Wrote " + std::to_string(recordCount) + " log messages to " + path);
+        return ok;
+    }
+
+    bool ExpandDump(const std::string& path, FILE* out) {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) {
+            fprintf(stderr, "Could not open %s\n", path.c_str());
+            return false;
+        }
+        char magic[sizeof(DUMP_MAGIC)];
+        uint32_t formatCount = 0;
+        bool ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+            memcmp(magic, DUMP_MAGIC, sizeof(magic)) == 0 &&
+            fread(&formatCount, sizeof(formatCount), 1, file) == 1;
+
+        std::vector<std::string> dumpFormats;
+        for (uint32_t id = 0; ok && id < formatCount; id++) {
+            uint16_t length = 0;
+            ok = fread(&length, sizeof(length), 1, file) == 1;
+            std::string format(length, '\0');
+            ok = ok && fread(&format[0], 1, length, file) == length;
+            dumpFormats.push_back(std::move(format));
+        }
+
+        uint32_t recordCount = 0;
+        ok = ok && fread(&recordCount, sizeof(recordCount), 1, file) == 1;
+        std::string line;
+        for (uint32_t i = 0; ok && i < recordCount; i++) {
+            LogRecord record;
+            ok = fread(&record, 1, RECORD_HEADER_SIZE, file) == RECORD_HEADER_SIZE &&
+                record.argsSize <= MAX_ARGS_SIZE &&
+                fread(record.args, 1, record.argsSize, file) == record.argsSize;
+            if (!ok) {
+                break;
+            }
+            line = LEVEL_PREFIXES[std::min<int>(record.level, LEVEL_ERROR)];
+            line += DateTimeToString(record.timestampUs);
+            line += "]: ";
+            ExpandInto(record.formatId < dumpFormats.size() ? dumpFormats[record.formatId].c_str() : "<unknown format>",
+                       record, line);
+            line += '\n';
+            fwrite(line.data(), 1, line.size(), out);
+        }
+        fclose(file);
+        if (!ok) {
+            fprintf(stderr, "%s is not a complete log dump\n", path.c_str());
+        }
+        return ok;
+    }
+}
@@ -1,21 +1,196 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 
+// Messages are not formatted where they are logged. A call site
+// registers its format string once and each message is a fixed size
+// record holding the format id plus the packed arguments. The records go
+// through a lock-free ring buffer to a background thread which formats
+// and writes them out in batches, and keeps the latest HISTORY_CAPACITY
+// of them for the overlay's console and binary log dumps. When the ring
+// is full messages are dropped (and counted) rather than stalling the
+// caller.
+//
+// Every message has a level and a category. The LOG_* macros check both
+// against LOG_COMPILED_LEVEL/LOG_COMPILED_CATEGORIES at compile time and
+// against SetLevel/SetCategories at runtime before evaluating their
+// arguments, so a filtered message costs a branch at most and nothing at
+// all when it is compiled out:
+//
+//     LOG_TRACE(Logger::CATEGORY_ECS, "Entity created with id = {}", entityId);
 namespace Logger {
-    enum LogEntryType {
-        LOG_INFO,
-        LOG_ERROR,
+    enum LogLevel {
+        LEVEL_TRACE,
+        LEVEL_DEBUG,
+        LEVEL_INFO,
+        LEVEL_WARN,
+        LEVEL_ERROR,
     };
 
-    struct LogEntry {
-        LogEntryType type;
-        std::string msg;
+    // Bit flags, combine them into a mask for SetCategories.
+    enum LogCategory : uint32_t {
+        CATEGORY_GENERAL = 1 << 0,
+        CATEGORY_ECS = 1 << 1,
+        CATEGORY_GAME = 1 << 2,
+        CATEGORY_ASSETS = 1 << 3,
+        CATEGORY_PROFILER = 1 << 4,
+        CATEGORY_ALL = 0xffffffff,
     };
 
+    // Bytes available for the packed arguments of one message. Strings
+    // that don't fit get truncated.
+    static const size_t MAX_ARGS_SIZE = 240;
+    // Messages kept in memory, the oldest get overwritten.
+    static const size_t HISTORY_CAPACITY = 4096;
+
+    // Argument tags, each tag byte is followed by the value.
+    enum LogArgType : uint8_t {
+        ARG_INT = 'i',     // int64_t
+        ARG_UINT = 'u',    // uint64_t
+        ARG_DOUBLE = 'f',  // double
+        ARG_STRING = 's',  // uint8_t length, then the characters
+    };
+
+    struct LogRecord {
+        int64_t timestampUs;
+        uint16_t formatId;
+        uint8_t level;
+        uint8_t argsSize;
+        uint8_t args[MAX_ARGS_SIZE];
+    };
+
+    // Returns the id of format, which has to outlive the logger (a string
+    // literal). "{}" in it gets replaced by the next argument.
+    uint16_t RegisterFormat(const char* format);
+    void Submit(const LogRecord& record);
+    int64_t NowUs();
+
+    // Runtime filter, read on every message that was compiled in.
+    extern std::atomic<int> runtimeLevel;
+    extern std::atomic<uint32_t> runtimeCategories;
+
+    inline bool IsEnabled(LogLevel level, uint32_t category) {
+        return level >= runtimeLevel.load(std::memory_order_relaxed) &&
+            (category & runtimeCategories.load(std::memory_order_relaxed)) != 0;
+    }
+
+    // Messages below level or outside the categories mask are skipped.
+    // Info and up of all categories by default.
+    void SetLevel(LogLevel level);
+    void SetCategories(uint32_t mask);
+    // Parses "trace", "debug", "info", "warn" or "error".
+    bool ParseLevel(const std::string& name, LogLevel& level);
+
+    inline void PackArg(LogRecord& record, LogArgType type, const void* value, size_t size) {
+        if (size_t(record.argsSize) + 1 + size > MAX_ARGS_SIZE) {
+            return;
+        }
+        record.args[record.argsSize++] = type;
+        memcpy(record.args + record.argsSize, value, size);
+        record.argsSize += size;
+    }
+
+    inline void PackArg(LogRecord& record, std::string_view value) {
+        if (size_t(record.argsSize) + 2 > MAX_ARGS_SIZE) {
+            return;
+        }
+        const size_t room = MAX_ARGS_SIZE - record.argsSize - 2;
+        const uint8_t length = uint8_t(std::min<size_t>({value.size(), room, 255}));
+        record.args[record.argsSize++] = ARG_STRING;
+        record.args[record.argsSize++] = length;
+        memcpy(record.args + record.argsSize, value.data(), length);
+        record.argsSize += length;
+    }
+
+    template <typename T>
+    void PackArg(LogRecord& record, const T& value) {
+        if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+            PackArg(record, std::string_view(value));
+        } else if constexpr (std::is_floating_point_v<T>) {
+            const double packed = value;
+            PackArg(record, ARG_DOUBLE, &packed, sizeof(packed));
+        } else if constexpr (std::is_signed_v<T>) {
+            const int64_t packed = value;
+            PackArg(record, ARG_INT, &packed, sizeof(packed));
+        } else {
+            static_assert(std::is_integral_v<T> || std::is_enum_v<T>, "Unsupported log argument type");
+            const uint64_t packed = uint64_t(value);
+            PackArg(record, ARG_UINT, &packed, sizeof(packed));
+        }
+    }
+
+    template <typename... TArgs>
+    void Write(LogLevel level, uint16_t formatId, const TArgs&... args) {
+        LogRecord record;
+        record.timestampUs = NowUs();
+        record.formatId = formatId;
+        record.level = level;
+        record.argsSize = 0;
+        (PackArg(record, args), ...);
+        Submit(record);
+    }
+
+    // Already formatted messages of the general category, for cold paths.
     void Log(const std::string& msg);
     void Err(const std::string& msg);
+    // Blocks until everything logged before the call has been written.
+    void Flush();
+    // Where the writer thread writes to, stdout by default. nullptr
+    // discards the output.
+    void SetOutput(FILE* output);
+    // Messages lost because the ring buffer was full.
+    uint64_t GetDroppedCount();
+
+    // Expands a record into its message.
+    std::string FormatRecord(const LogRecord& record);
+    // Appends up to maxCount of the most recent messages, oldest first.
+    void CopyHistory(std::vector<LogRecord>& out, size_t maxCount = HISTORY_CAPACITY);
+    // Writes the format table and the history to path, the layout is
+    // described in Logger.cpp.
+    bool DumpHistory(const std::string& path);
+    // Reads a dump written by DumpHistory and writes the expanded
+    // messages to output.
+    bool ExpandDump(const std::string& path, FILE* output);
 }
 
+// Messages below this level or outside these categories are compiled
+// out. Release builds (NDEBUG) keep info and up, others everything.
+#ifndef LOG_COMPILED_LEVEL
+#ifdef NDEBUG
+#define LOG_COMPILED_LEVEL Logger::LEVEL_INFO
+#else
+#define LOG_COMPILED_LEVEL Logger::LEVEL_TRACE
+#endif
+#endif
+#ifndef LOG_COMPILED_CATEGORIES
+#define LOG_COMPILED_CATEGORIES Logger::CATEGORY_ALL
+#endif
+
+// The arguments are only evaluated, and the format only registered, once
+// the message passed both filters.
+#define LOGGER_WRITE(level, category, format, ...) \
+    do { \
+        if constexpr ((level) >= (LOG_COMPILED_LEVEL) && ((category) & (LOG_COMPILED_CATEGORIES)) != 0) { \
+            if (Logger::IsEnabled(level, category)) { \
+                static const uint16_t loggerFormatId = Logger::RegisterFormat(format); \
+                Logger::Write(level, loggerFormatId, ##__VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+
+#define LOG_TRACE(category, format, ...) LOGGER_WRITE(Logger::LEVEL_TRACE, category, format, ##__VA_ARGS__)
+#define LOG_DEBUG(category, format, ...) LOGGER_WRITE(Logger::LEVEL_DEBUG, category, format, ##__VA_ARGS__)
+#define LOG_INFO(category, format, ...) LOGGER_WRITE(Logger::LEVEL_INFO, category, format, ##__VA_ARGS__)
+#define LOG_WARN(category, format, ...) LOGGER_WRITE(Logger::LEVEL_WARN, category, format, ##__VA_ARGS__)
+#define LOG_ERROR(category, format, ...) LOGGER_WRITE(Logger::LEVEL_ERROR, category, format, ##__VA_ARGS__)
+
 #endif
@@ -1,9 +1,147 @@
 #include "./Game/Game.h"
+#include "./Logger/Logger.h"
+#include <cstdlib>
+#include <string>
+
+// Usage: 2dge [--headless] [--fps N] [--frames N] [--sim-hz N] [--max-steps N]
+//             [--profile-frames N] [--profile-out FILE] [--log-dump FILE]
+//             [--log-level trace|debug|info|warn|error] [--flight-recorder FILE]
+//             [--record-input FILE] [--replay-input FILE]
+//             [--atlas-size PX] [--asset-archive FILE|off] [--hot-reload on|off]
+//             [--map FILE] [--chunk-budget MB] [--sprite-batching on|off]
+//             [--stress N] [--tanks N] [--trucks N] [--choppers N] [--bullets N]
+//             [--speed PX_PER_S] [--bullet-speed PX_PER_S] [--churn FRACTION_PER_S] [--seed N]
+//
+// --stress N spreads N units between tanks, trucks, choppers and bullets,
+// the per-type flags override that split.
+//
+// --atlas-size 0 gives every image a texture of its own instead of
+// packing them into atlas pages.
+// --asset-archive off loads the loose files under ./assets/ even when
+// there is an archive.
+static bool ParseArgs(int argc, char* argv[], GameOptions& options) {
+    auto& stress = options.stressConfig;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--headless") {
+            options.headless = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            Logger::Err("Missing value for argument " + arg);
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--fps") {
+            options.targetFps = std::atoi(value);
+        } else if (arg == "--frames") {
+            options.maxFrames = std::atoi(value);
+        } else if (arg == "--sim-hz") {
+            options.simulationHz = std::atoi(value);
+        } else if (arg == "--max-steps") {
+            options.maxStepsPerFrame = std::atoi(value);
+        } else if (arg == "--profile-frames") {
+            options.profileFrames = std::atoi(value);
+        } else if (arg == "--profile-out") {
+            options.profileOutput = value;
+        } else if (arg == "--log-dump") {
+            options.logDump = value;
+        } else if (arg == "--flight-recorder") {
+            options.flightRecorder = std::string(value) == "off" ? "" : value;
+        } else if (arg == "--log-level") {
+            Logger::LogLevel level;
+            if (!Logger::ParseLevel(value, level)) {
+                Logger::Err(std::string("Unknown log level ") + value);
+                return false;
+            }
+            Logger::SetLevel(level);
+        } else if (arg == "--map") {
+            options.mapFile = value;
+        } else if (arg == "--chunk-budget") {
+            // In MB.
+            const int megabytes = std::atoi(value);
+            if (megabytes < 0) {
+                Logger::Err("--chunk-budget can't be negative");
+                return false;
+            }
+            options.chunkBudget = size_t(megabytes) << 20;
+        } else if (arg == "--asset-archive") {
+            options.assetArchive = std::string(value) == "off" ? "" : value;
+        } else if (arg == "--sprite-batching") {
+            options.spriteBatching = std::string(value) != "off";
+        } else if (arg == "--hot-reload") {
+            options.hotReload = std::string(value) != "off";
+        } else if (arg == "--atlas-size") {
+            options.atlasPageSize = std::atoi(value);
+        } else if (arg == "--record-input") {
+            options.recordInput = value;
+        } else if (arg == "--replay-input") {
+            options.replayInput = value;
+        } else if (arg == "--stress") {
+            const int numUnits = std::atoi(value);
+            options.stressScenario = true;
+            stress.numTanks = numUnits * 4 / 10;
+            stress.numTrucks = numUnits * 3 / 10;
+            stress.numChoppers = numUnits / 10;
+            stress.numBullets = numUnits - stress.numTanks - stress.numTrucks - stress.numChoppers;
+        } else if (arg == "--tanks") {
+            options.stressScenario = true;
+            stress.numTanks = std::atoi(value);
+        } else if (arg == "--trucks") {
+            options.stressScenario = true;
+            stress.numTrucks = std::atoi(value);
+        } else if (arg == "--choppers") {
+            options.stressScenario = true;
+            stress.numChoppers = std::atoi(value);
+        } else if (arg == "--bullets") {
+            options.stressScenario = true;
+            stress.numBullets = std::atoi(value);
+        } else if (arg == "--speed") {
+            stress.unitSpeed = std::atof(value);
+        } else if (arg == "--bullet-speed") {
+            stress.bulletSpeed = std::atof(value);
+        } else if (arg == "--churn") {
+            stress.churnPerSecond = std::atof(value);
+        } else if (arg == "--seed") {
+            stress.seed = std::strtoul(value, nullptr, 10);
+        } else {
+            Logger::Err("Unknown argument " + arg);
+            return false;
+        }
+    }
+    if (!options.recordInput.empty() && !options.replayInput.empty()) {
+        Logger::Err("--record-input and --replay-input can't be used together");
+        return false;
+    }
+    // The fixed step loop needs a step and room for at least one of them
+    // per frame.
+    if (options.simulationHz <= 0) {
+        Logger::Err("--sim-hz has to be above 0");
+        return false;
+    }
+    if (options.maxStepsPerFrame <= 0) {
+        Logger::Err("--max-steps has to be above 0");
+        return false;
+    }
+    if (options.headless && options.maxFrames <= 0 && options.replayInput.empty()) {
+        Logger::Err("--headless needs --frames N or --replay-input, there is no window to close");
+        return false;
+    }
+    return true;
+}
 
 int main(int argc, char* argv[]) {
+    GameOptions options;
+    if (!ParseArgs(argc, argv, options)) {
+        return 1;
+    }
+
     Game game;
 
-    game.Initialize(120);
+    if (!game.Initialize(options)) {
+        game.Destroy();
+        return 1;
+    }
     game.Run();
     game.Destroy();
 
@@ -0,0 +1,188 @@
+#include "Profiler.h"
+#include "../Logger/Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Profiler {
+    std::atomic<bool> capturing(false);
+    std::atomic<bool> recording(false);
+    static std::atomic<ScopeSink> scopeSink(nullptr);
+
+    // Events each thread can hold, older ones get overwritten.
+    static const uint64_t EVENTS_PER_THREAD = 1 << 18;
+
+    // Single producer ring: only the owning thread writes events and
+    // publishes them by bumping head.
+    struct ThreadBuffer {
+        std::vector<Event> events;
+        std::atomic<uint64_t> head;
+        uint64_t captureStart;
+        uint32_t threadIndex;
+        // Its thread exited, it goes away once its events were written.
+        bool retired;
+
+        ThreadBuffer(uint32_t index) : events(EVENTS_PER_THREAD), head(0), captureStart(0), threadIndex(index), retired(false) {}
+    };
+
+    // Retires the thread's buffer when the thread exits.
+    struct ThreadBufferOwner {
+        ThreadBuffer* buffer = nullptr;
+        ~ThreadBufferOwner();
+    };
+
+    // Buffers outlive their thread so they can still be dumped, retired
+    // ones are freed when the capture gets written or the next one
+    // starts. The mutex is only taken when a thread records for the first
+    // time, when it exits and when a capture starts or gets written.
+    static std::mutex buffersMutex;
+    static std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    static thread_local ThreadBufferOwner threadBuffer;
+    // Handed out on a thread's first scope, whether it ever gets a buffer
+    // or not, so sinks see the same index the Chrome traces use.
+    static std::atomic<uint32_t> nextThreadIndex(0);
+    static thread_local int64_t threadIndex = -1;
+
+    static uint64_t captureEpochNs = 0;
+    static int framesLeftToCapture = 0;
+    static std::string pendingCapturePath;
+
+    static uint32_t ThreadIndex() {
+        if (threadIndex < 0) {
+            threadIndex = nextThreadIndex.fetch_add(1, std::memory_order_relaxed);
+        }
+        return uint32_t(threadIndex);
+    }
+
+    // Only threads that record during a capture get a buffer, they take
+    // a few MB each.
+    static ThreadBuffer* RegisterThread() {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffers.push_back(std::make_unique<ThreadBuffer>(ThreadIndex()));
+        threadBuffer.buffer = buffers.back().get();
+        return threadBuffer.buffer;
+    }
+
+    ThreadBufferOwner::~ThreadBufferOwner() {
+        if (buffer) {
+            std::lock_guard<std::mutex> lock(buffersMutex);
+            buffer->retired = true;
+        }
+    }
+
+    // Worker threads come and go (a new loader per map), without this
+    // each would keep its few MB for good. buffersMutex must be held.
+    static void FreeRetiredBuffers() {
+        buffers.erase(
+            std::remove_if(buffers.begin(), buffers.end(), [](const std::unique_ptr<ThreadBuffer>& buffer) {
+                return buffer->retired;
+            }),
+            buffers.end()
+        );
+    }
+
+    uint64_t NowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+    }
+
+    static void UpdateRecording() {
+        recording.store(
+            capturing.load(std::memory_order_relaxed) || scopeSink.load(std::memory_order_relaxed),
+            std::memory_order_relaxed
+        );
+    }
+
+    void Record(const char* name, uint64_t beginNs, uint64_t endNs) {
+        if (IsCapturing()) {
+            ThreadBuffer* buffer = threadBuffer.buffer ? threadBuffer.buffer : RegisterThread();
+            const uint64_t head = buffer->head.load(std::memory_order_relaxed);
+            buffer->events[head & (EVENTS_PER_THREAD - 1)] = {name, beginNs, endNs};
+            buffer->head.store(head + 1, std::memory_order_release);
+        }
+        if (ScopeSink sink = scopeSink.load(std::memory_order_relaxed)) {
+            sink(name, beginNs, endNs, ThreadIndex());
+        }
+    }
+
+    void SetScopeSink(ScopeSink sink) {
+        scopeSink.store(sink, std::memory_order_relaxed);
+        UpdateRecording();
+    }
+
+    void BeginCapture() {
+        {
+            std::lock_guard<std::mutex> lock(buffersMutex);
+            FreeRetiredBuffers();
+            for (auto& buffer : buffers) {
+                buffer->captureStart = buffer->head.load(std::memory_order_acquire);
+            }
+        }
+        captureEpochNs = NowNs();
+        capturing.store(true, std::memory_order_relaxed);
+        UpdateRecording();
+    }
+
+    void EndCapture() {
+        capturing.store(false, std::memory_order_relaxed);
+        UpdateRecording();
+    }
+
+    void CaptureFrames(int numFrames, const std::string& path) {
+        framesLeftToCapture = numFrames;
+        pendingCapturePath = path;
+        BeginCapture();
+    }
+
+    void OnFrameEnd() {
+        if (framesLeftToCapture > 0 && --framesLeftToCapture == 0) {
+            EndCapture();
+            WriteChromeTrace(pendingCapturePath);
+        }
+    }
+
+    bool WriteChromeTrace(const std::string& path) {
+        std::ofstream file(path);
+        if (!file) {
+            Logger::Err("Error opening profiler capture file " + path);
+            return false;
+        }
+
+        file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+        bool first = true;
+        size_t numEvents = 0;
+        char line[256];
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        for (const auto& buffer : buffers) {
+            const uint64_t head = buffer->head.load(std::memory_order_acquire);
+            uint64_t begin = buffer->captureStart;
+            if (head - begin > EVENTS_PER_THREAD) {
+                begin = head - EVENTS_PER_THREAD;
+            }
+            for (uint64_t i = begin; i < head; i++) {
+                const Event& event = buffer->events[i & (EVENTS_PER_THREAD - 1)];
+                if (event.beginNs < captureEpochNs) {
+                    continue;
+                }
+                // Chrome traces are in microseconds.
+                snprintf(line, sizeof(line),
+                         "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                         first ? "" : ",\n", event.name, buffer->threadIndex,
+                         (event.beginNs - captureEpochNs) / 1000.0, (event.endNs - event.beginNs) / 1000.0);
+                file << line;
+                first = false;
+                numEvents++;
+            }
+        }
+        file << "\n]}\n";
+        FreeRetiredBuffers();
+
+        Logger::Log("Wrote " + std::to_string(numEvents) + " profiler events to " + path);
+        return true;
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Scoped instrumentation:
+//
+//     void MovementSystem::Update(...) {
+//         PROFILE_SCOPE("MovementSystem");
+//         ...
+//     }
+//
+// records when the scope starts and ends into a ring buffer owned by the
+// calling thread, but only while a capture is running, and hands it to
+// the scope sink if one is set. Otherwise a scope costs one relaxed
+// atomic load. Captures can be written out in the Chrome trace format
+// (chrome://tracing, ui.perfetto.dev).
+//
+// Without ENABLE_PROFILER the macros expand to nothing.
+namespace Profiler {
+    struct Event {
+        // Must point to a string that outlives the capture (a literal).
+        const char* name;
+        uint64_t beginNs;
+        uint64_t endNs;
+    };
+
+    // Called with every scope, capture or not. threadIndex is the same
+    // as the tid of the Chrome traces.
+    using ScopeSink = void (*)(const char* name, uint64_t beginNs, uint64_t endNs, uint32_t threadIndex);
+
+    extern std::atomic<bool> capturing;
+    // Capturing or a sink is set: scopes need timing.
+    extern std::atomic<bool> recording;
+
+    uint64_t NowNs();
+    void Record(const char* name, uint64_t beginNs, uint64_t endNs);
+
+    void BeginCapture();
+    void EndCapture();
+    inline bool IsCapturing() { return capturing.load(std::memory_order_relaxed); }
+    inline bool IsRecording() { return recording.load(std::memory_order_relaxed); }
+    // nullptr removes the sink.
+    void SetScopeSink(ScopeSink sink);
+
+    // Captures the next numFrames frames and then writes them to path.
+    void CaptureFrames(int numFrames, const std::string& path);
+    // Marks the end of a frame, drives CaptureFrames.
+    void OnFrameEnd();
+
+    // Writes the events of the last capture. Call it once the capture
+    // ended, threads still recording could overwrite what is being read.
+    bool WriteChromeTrace(const std::string& path);
+
+    class Scope {
+        private:
+            const char* m_name;
+            uint64_t m_beginNs;
+
+        public:
+            Scope(const char* name) : m_name(nullptr), m_beginNs(0) {
+                if (IsRecording()) {
+                    m_name = name;
+                    m_beginNs = NowNs();
+                }
+            }
+
+            ~Scope() {
+                if (m_name) {
+                    Record(m_name, m_beginNs, NowNs());
+                }
+            }
+    };
+}
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef ENABLE_PROFILER
+#define PROFILE_SCOPE(name) Profiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_FRAME_END() Profiler::OnFrameEnd()
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_FRAME_END()
+#endif
+
+#endif
@@ -1,21 +1,26 @@
 #ifndef MOVEMENT_SYSTEM_H
 #define MOVEMENT_SYSTEM_H
 
+#include "../ECS/ECS.h"
+#include "../Components/TransformComponent.h"
+#include "../Components/RigidBodyComponent.h"
+
 class MovementSystem: public System {
     public:
     MovementSystem() {
-        // TODO...
-        // RequireComponent<TransformComponent>();
-        // RequireComponent<...>();
+        RequireComponent<TransformComponent>();
+        RequireComponent<RigidBodyComponent>();
     }
 
-    void Update() {
-        // TODO ...
+    void Update(Registry& registry, float deltaT) {
         // Iterate all of the entities that the system is intersted in
         for (auto entity : GetEntities()) {
-            // TODO: Update their velocities and position, etc.
+            auto& transform = registry.GetComponent<TransformComponent>(entity);
+            const auto& rigidBody = registry.GetComponent<RigidBodyComponent>(entity);
+
+            transform.position += rigidBody.velocity * deltaT;
         }
     }
 };
 
-#endif
\ No newline at end of file
+#endif
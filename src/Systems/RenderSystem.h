@@ -0,0 +1,290 @@
+#ifndef RENDER_SYSTEM_H
+#define RENDER_SYSTEM_H
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <cstdint>
+#include <vector>
+#include "../ECS/ECS.h"
+#include "../AssetStore/AssetStore.h"
+#include "../Components/TransformComponent.h"
+#include "../Components/SpriteComponent.h"
+#include "../Profiler/Profiler.h"
+
+// SDL_RenderGeometry is new in SDL 2.0.18.
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+#define RENDER_SYSTEM_GEOMETRY 1
+#endif
+
+// Draws the sprites in z-index order. Every frame the visible sprites
+// are turned into a flat array of draw commands, which is sorted by z-index
+// and then by texture so sprites on the same texture (the same atlas page)
+// go out one after another, and then drawn in that order. Within a key the
+// sort is stable, so sprites keep the order of the entities.
+//
+// Runs of sprites on the same texture are turned into quads, rotated
+// and flipped on the CPU, and submitted with one SDL_RenderGeometry call
+// per run instead of a SDL_RenderCopyEx per sprite. Before SDL 2.0.18,
+// or with batching turned off, every sprite is its own call.
+class RenderSystem: public System {
+    private:
+    struct DrawCommand {
+        // nullptr draws a white rectangle.
+        SDL_Texture* texture;
+        SDL_Rect srcRect;
+        SDL_Rect dstRect;
+        double rotation;
+        SDL_RendererFlip flip;
+    };
+
+    struct SortItem {
+        // z-index in the high 32 bits (biased so negative ones sort first),
+        // texture id in the low 32.
+        uint64_t key;
+        uint32_t command;
+    };
+
+    std::vector<DrawCommand> m_commands;
+    std::vector<SortItem> m_sortItems;
+    std::vector<SortItem> m_sortScratch;
+    // The textures drawn this frame, the index is the texture's id in the
+    // sort key. Small ids leave the upper bytes of the key alone, so the
+    // sort only needs a pass for the id and one for the z-index.
+    std::vector<SDL_Texture*> m_textures;
+    bool m_batching = true;
+    size_t m_numDrawCalls = 0;
+#ifdef RENDER_SYSTEM_GEOMETRY
+    std::vector<SDL_Vertex> m_vertices;
+    std::vector<int> m_indices;
+#endif
+
+    uint32_t TextureId(SDL_Texture* texture) {
+        // There are only a few textures (atlas pages) and consecutive
+        // sprites mostly share the last one.
+        if (!m_textures.empty() && m_textures.back() == texture) {
+            return uint32_t(m_textures.size() - 1);
+        }
+        auto it = std::find(m_textures.begin(), m_textures.end(), texture);
+        if (it != m_textures.end()) {
+            return uint32_t(it - m_textures.begin());
+        }
+        m_textures.push_back(texture);
+        return uint32_t(m_textures.size() - 1);
+    }
+
+    static uint64_t SortKey(int zIndex, uint32_t textureId) {
+        return (uint64_t(uint32_t(zIndex) ^ 0x80000000u) << 32) | textureId;
+    }
+
+    // LSD radix sort of items by key, a byte per pass. The counts of all
+    // bytes are taken in one go up front, passes over a byte that is the
+    // same in every key are skipped, usually that is most of them.
+    static void RadixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch) {
+        size_t counts[8][256] = {};
+        for (const SortItem& item : items) {
+            for (int byte = 0; byte < 8; byte++) {
+                counts[byte][(item.key >> (byte * 8)) & 0xff]++;
+            }
+        }
+        scratch.resize(items.size());
+        for (int byte = 0; byte < 8; byte++) {
+            const int shift = byte * 8;
+            if (counts[byte][(items[0].key >> shift) & 0xff] == items.size()) {
+                continue;
+            }
+            size_t offset = 0;
+            for (size_t& count : counts[byte]) {
+                const size_t bucketSize = count;
+                count = offset;
+                offset += bucketSize;
+            }
+            for (const SortItem& item : items) {
+                scratch[counts[byte][(item.key >> shift) & 0xff]++] = item;
+            }
+            items.swap(scratch);
+        }
+    }
+
+    public:
+    RenderSystem() {
+        RequireComponent<TransformComponent>();
+        RequireComponent<SpriteComponent>();
+    }
+
+    // alpha is how far into the next simulation step the frame is drawn
+    // (0 = previous state, 1 = current state). camera is the part of the
+    // world on screen.
+    void Update(SDL_Renderer* renderer, Registry& registry, const AssetStore& assetStore, float alpha, const SDL_Rect& camera) {
+        m_commands.clear();
+        m_sortItems.clear();
+        m_textures.clear();
+        {
+            PROFILE_SCOPE("RenderSystem::Collect");
+            for (auto entity : GetEntities()) {
+                const auto& transform = registry.GetComponent<TransformComponent>(entity);
+                const auto& sprite = registry.GetComponent<SpriteComponent>(entity);
+                const glm::vec2 position = glm::mix(transform.previousPosition, transform.position, alpha);
+
+                // Value-initialized: sprites without a texture keep an empty
+                // source rect, which WriteQuad still reads.
+                DrawCommand command{};
+                command.dstRect = {
+                    static_cast<int>(position.x) - camera.x,
+                    static_cast<int>(position.y) - camera.y,
+                    static_cast<int>(sprite.width * transform.scale.x),
+                    static_cast<int>(sprite.height * transform.scale.y)
+                };
+                // Rotation turns a sprite around its center, it stays within
+                // its rect grown by half its longest side.
+                const int margin = std::max(command.dstRect.w, command.dstRect.h) / 2;
+                if (command.dstRect.x + command.dstRect.w + margin < 0 || command.dstRect.x - margin > camera.w ||
+                    command.dstRect.y + command.dstRect.h + margin < 0 || command.dstRect.y - margin > camera.h) {
+                    continue;
+                }
+                // The source rect is relative to the image, which may be one
+                // of many on an atlas page.
+                const TextureRegion* region = assetStore.GetTextureRegion(sprite.texture);
+                command.texture = region ? region->texture : nullptr;
+                if (region) {
+                    command.srcRect = {
+                        region->rect.x + sprite.srcRect.x,
+                        region->rect.y + sprite.srcRect.y,
+                        sprite.srcRect.w,
+                        sprite.srcRect.h
+                    };
+                }
+                command.rotation = glm::mix(transform.previousRotation, transform.rotation, double(alpha));
+                command.flip = sprite.flip;
+                m_sortItems.push_back({SortKey(sprite.zIndex, TextureId(command.texture)), uint32_t(m_commands.size())});
+                m_commands.push_back(command);
+            }
+        }
+        if (m_commands.empty()) {
+            return;
+        }
+        {
+            PROFILE_SCOPE("RenderSystem::Sort");
+            RadixSort(m_sortItems, m_sortScratch);
+        }
+
+        PROFILE_SCOPE("RenderSystem::Draw");
+#ifdef RENDER_SYSTEM_GEOMETRY
+        if (m_batching) {
+            DrawBatched(renderer);
+            return;
+        }
+#endif
+        DrawEach(renderer);
+    }
+
+    // Turns batching into SDL_RenderGeometry calls on and off, for
+    // comparing the two.
+    void SetBatching(bool batching) { m_batching = batching; }
+    // Sprites and the draw calls they took in the last Update.
+    size_t GetNumDrawn() const { return m_commands.size(); }
+    size_t GetNumDrawCalls() const { return m_numDrawCalls; }
+
+    private:
+    void DrawEach(SDL_Renderer* renderer) {
+        m_numDrawCalls = m_sortItems.size();
+        // Sprites without a texture show up as white rectangles.
+        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+        for (const SortItem& item : m_sortItems) {
+            const DrawCommand& command = m_commands[item.command];
+            if (command.texture) {
+                SDL_RenderCopyEx(renderer, command.texture, &command.srcRect, &command.dstRect, command.rotation, nullptr, command.flip);
+            } else {
+                SDL_RenderFillRect(renderer, &command.dstRect);
+            }
+        }
+    }
+
+#ifdef RENDER_SYSTEM_GEOMETRY
+    void DrawBatched(SDL_Renderer* renderer) {
+        m_numDrawCalls = 0;
+        size_t first = 0;
+        while (first < m_sortItems.size()) {
+            // The run of sprites on this texture, the sort put them next to
+            // each other.
+            SDL_Texture* texture = m_commands[m_sortItems[first].command].texture;
+            size_t last = first + 1;
+            while (last < m_sortItems.size() && m_commands[m_sortItems[last].command].texture == texture) {
+                last++;
+            }
+
+            // Texture coordinates are normalized, a texture without one
+            // draws white quads.
+            float uScale = 0.0f;
+            float vScale = 0.0f;
+            int textureWidth = 0;
+            int textureHeight = 0;
+            if (texture && SDL_QueryTexture(texture, nullptr, nullptr, &textureWidth, &textureHeight) == 0) {
+                uScale = 1.0f / textureWidth;
+                vScale = 1.0f / textureHeight;
+            }
+            const size_t numQuads = last - first;
+            m_vertices.resize(numQuads * 4);
+            m_indices.resize(numQuads * 6);
+            for (size_t i = 0; i < numQuads; i++) {
+                WriteQuad(m_commands[m_sortItems[first + i].command], uScale, vScale, int(i * 4), &m_vertices[i * 4], &m_indices[i * 6]);
+            }
+            SDL_RenderGeometry(renderer, texture, m_vertices.data(), int(m_vertices.size()), m_indices.data(), int(m_indices.size()));
+            m_numDrawCalls++;
+            first = last;
+        }
+    }
+
+    // Writes the four corners and two triangles of command, rotated
+    // around the center of its rect like SDL_RenderCopyEx does (degrees,
+    // clockwise). base is the index of the first vertex.
+    static void WriteQuad(const DrawCommand& command, float uScale, float vScale, int base, SDL_Vertex* vertices, int* indices) {
+        const SDL_Rect& dst = command.dstRect;
+        const SDL_Rect& src = command.srcRect;
+        const float halfWidth = dst.w * 0.5f;
+        const float halfHeight = dst.h * 0.5f;
+        const float centerX = dst.x + halfWidth;
+        const float centerY = dst.y + halfHeight;
+        float cosine = 1.0f;
+        float sine = 0.0f;
+        if (command.rotation != 0.0) {
+            const float radians = glm::radians(float(command.rotation));
+            cosine = std::cos(radians);
+            sine = std::sin(radians);
+        }
+        // The corner (halfWidth, halfHeight) rotated, the others are it and
+        // its perpendicular, mirrored.
+        const float axisX = halfWidth * cosine - halfHeight * sine;
+        const float axisY = halfWidth * sine + halfHeight * cosine;
+        const float otherX = halfWidth * cosine + halfHeight * sine;
+        const float otherY = halfWidth * sine - halfHeight * cosine;
+
+        float u0 = src.x * uScale;
+        float u1 = (src.x + src.w) * uScale;
+        float v0 = src.y * vScale;
+        float v1 = (src.y + src.h) * vScale;
+        if (command.flip & SDL_FLIP_HORIZONTAL) {
+            std::swap(u0, u1);
+        }
+        if (command.flip & SDL_FLIP_VERTICAL) {
+            std::swap(v0, v1);
+        }
+
+        // Top left, top right, bottom right, bottom left.
+        const SDL_Color white = {255, 255, 255, 255};
+        vertices[0] = {{centerX - axisX, centerY - axisY}, white, {u0, v0}};
+        vertices[1] = {{centerX + otherX, centerY + otherY}, white, {u1, v0}};
+        vertices[2] = {{centerX + axisX, centerY + axisY}, white, {u1, v1}};
+        vertices[3] = {{centerX - otherX, centerY - otherY}, white, {u0, v1}};
+        indices[0] = base;
+        indices[1] = base + 1;
+        indices[2] = base + 2;
+        indices[3] = base + 2;
+        indices[4] = base + 3;
+        indices[5] = base;
+    }
+#endif
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef SPATIAL_SORT_SYSTEM_H
+#define SPATIAL_SORT_SYSTEM_H
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "../ECS/ECS.h"
+#include "../Components/TransformComponent.h"
+
+// Keeps the transform pool (and the pools grouped with it) ordered by the
+// Morton code of the entity position, so entities that are close to each
+// other in the world are also close to each other in memory.
+template <typename... TGrouped>
+class SpatialSortSystem: public System {
+    private:
+    // Size in world units of the grid cells positions get quantized to.
+    float m_cellSize;
+    // Sort every this many frames to spread the cost on huge worlds
+    // where entities barely move from one frame to the next.
+    int m_framesBetweenSorts;
+    int m_framesSinceSort = 0;
+
+    // Spreads the lower 16 bits of v so there is a zero between each of them.
+    static uint32_t SpreadBits(uint32_t v) {
+        v &= 0x0000FFFF;
+        v = (v | (v << 8)) & 0x00FF00FF;
+        v = (v | (v << 4)) & 0x0F0F0F0F;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    }
+
+    public:
+    SpatialSortSystem(float cellSize = 32.0f, int framesBetweenSorts = 1)
+        : m_cellSize(cellSize), m_framesBetweenSorts(framesBetweenSorts) {
+        RequireComponent<TransformComponent>();
+    }
+
+    static uint32_t MortonCode(const glm::vec2& position, float cellSize) {
+        const glm::vec2 cell = glm::clamp(position / cellSize, glm::vec2(0.0f), glm::vec2(65535.0f));
+        return SpreadBits(uint32_t(cell.x)) | (SpreadBits(uint32_t(cell.y)) << 1);
+    }
+
+    void Update(Registry& registry) {
+        if (++m_framesSinceSort < m_framesBetweenSorts) {
+            return;
+        }
+        m_framesSinceSort = 0;
+
+        const float cellSize = m_cellSize;
+        registry.SortComponents<TransformComponent, TGrouped...>(
+            [cellSize](const TransformComponent& transform) {
+                return MortonCode(transform.position, cellSize);
+            }
+        );
+    }
+};
+
+#endif
@@ -0,0 +1,68 @@
+// Checks of the CSV tilemap parser.
+//
+// Usage: 2dge_tilemap_test
+//
+// Prints every failed check and exits with 1 if there was any.
+
+#include "AssetStore/Tilemap.h"
+#include "Logger/Logger.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static int numFailed = 0;
+
+static void Check(bool condition, const char* what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what);
+        numFailed++;
+    }
+}
+
+static bool Parse(Tilemap& tilemap, const char* text) {
+    return tilemap.ParseCsv(text, strlen(text), "test");
+}
+
+static bool HasTiles(const Tilemap& tilemap, int numCols, int numRows, const std::vector<uint16_t>& tiles) {
+    return tilemap.GetNumCols() == numCols && tilemap.GetNumRows() == numRows &&
+        std::vector<uint16_t>(tilemap.GetTiles(), tilemap.GetTiles() + tiles.size()) == tiles;
+}
+
+static void TestPlainRows() {
+    Tilemap tilemap;
+    Check(Parse(tilemap, "1,2,3\n4,5,6\n"), "plain rows parse");
+    Check(HasTiles(tilemap, 3, 2, {1, 2, 3, 4, 5, 6}), "plain rows keep their tiles");
+    Check(Parse(tilemap, "1,2\r\n3,4"), "CRLF rows without a final newline parse");
+    Check(HasTiles(tilemap, 2, 2, {1, 2, 3, 4}), "CRLF rows keep their tiles");
+}
+
+static void TestTrailingCommas() {
+    Tilemap tilemap;
+    Check(Parse(tilemap, "1,2,3,\n4,5,6,\n"), "rows with trailing commas parse");
+    Check(HasTiles(tilemap, 3, 2, {1, 2, 3, 4, 5, 6}), "trailing commas end the row");
+    Check(Parse(tilemap, "1,2,\r\n3,4,\r\n"), "CRLF rows with trailing commas parse");
+    Check(HasTiles(tilemap, 2, 2, {1, 2, 3, 4}), "trailing commas end CRLF rows");
+    Check(Parse(tilemap, "1,2,\n3,4"), "a trailing comma on some rows only parses");
+    Check(HasTiles(tilemap, 2, 2, {1, 2, 3, 4}), "mixed rows keep their tiles");
+    Check(Parse(tilemap, "1,2\n3,4,"), "a trailing comma at the end of the file parses");
+    Check(HasTiles(tilemap, 2, 2, {1, 2, 3, 4}), "the last row ends at the end of the file");
+}
+
+static void TestErrors() {
+    Tilemap tilemap;
+    Check(!Parse(tilemap, "1,2,3\n4,5\n"), "rows of different widths are rejected");
+    Check(!Parse(tilemap, "1,2,3,\n4,5,\n"), "rows of different widths with trailing commas are rejected");
+    Check(!Parse(tilemap, "1;2\n"), "other separators are rejected");
+    Check(!Parse(tilemap, "1,x\n"), "tiles that aren't numbers are rejected");
+    Check(!Parse(tilemap, "\n\n"), "maps without tiles are rejected");
+}
+
+int main() {
+    TestPlainRows();
+    TestTrailingCommas();
+    TestErrors();
+    Logger::Flush();
+    printf("%s\n", numFailed == 0 ? "All tilemap checks passed" : "Some tilemap checks failed");
+    return numFailed == 0 ? 0 : 1;
+}
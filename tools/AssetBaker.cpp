@@ -0,0 +1,199 @@
+// Bakes an asset directory into an archive the game maps into memory
+// (see AssetArchive.h): PNGs are decoded to raw pixels, CSV tilemaps
+// parsed into tile ids and fonts copied as they are.
+//
+// Usage: 2dge_assetbaker <assets dir> <archive>
+//        2dge_assetbaker --tilemap <map.map> <map.tmb>
+//
+// The second form converts a single CSV tilemap to the binary .tmb
+// format (see Tilemap.h).
+#include "AssetStore/AssetArchive.h"
+#include "AssetStore/Tilemap.h"
+#include "Logger/Logger.h"
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct BakedAsset {
+    ArchiveEntry entry;
+    std::vector<uint8_t> data;
+};
+
+// The format textures are created in, 4 bytes per pixel.
+static const Uint32 PIXEL_FORMAT = SDL_PIXELFORMAT_RGBA32;
+
+static bool BakeImage(const fs::path& path, BakedAsset& asset) {
+    SDL_Surface* loaded = IMG_Load(path.string().c_str());
+    if (!loaded) {
+        fprintf(stderr, "Could not load %s: %s\n", path.string().c_str(), IMG_GetError());
+        return false;
+    }
+    SDL_Surface* surface = SDL_ConvertSurfaceFormat(loaded, PIXEL_FORMAT, 0);
+    SDL_FreeSurface(loaded);
+    if (!surface) {
+        fprintf(stderr, "Could not convert %s: %s\n", path.string().c_str(), SDL_GetError());
+        return false;
+    }
+    asset.entry.type = ARCHIVE_IMAGE;
+    asset.entry.format = PIXEL_FORMAT;
+    asset.entry.width = uint32_t(surface->w);
+    asset.entry.height = uint32_t(surface->h);
+    const size_t rowSize = size_t(surface->w) * 4;
+    asset.data.resize(rowSize * surface->h);
+    SDL_LockSurface(surface);
+    for (int y = 0; y < surface->h; y++) {
+        memcpy(asset.data.data() + y * rowSize, static_cast<const uint8_t*>(surface->pixels) + y * surface->pitch, rowSize);
+    }
+    SDL_UnlockSurface(surface);
+    SDL_FreeSurface(surface);
+    return true;
+}
+
+static bool BakeTilemap(const fs::path& path, BakedAsset& asset) {
+    Tilemap tilemap;
+    if (!tilemap.LoadCsv(path.string())) {
+        return false;
+    }
+    asset.entry.type = ARCHIVE_TILEMAP;
+    asset.entry.width = uint32_t(tilemap.GetNumCols());
+    asset.entry.height = uint32_t(tilemap.GetNumRows());
+    asset.data.resize(size_t(tilemap.GetNumCols()) * tilemap.GetNumRows() * sizeof(uint16_t));
+    memcpy(asset.data.data(), tilemap.GetTiles(), asset.data.size());
+    return true;
+}
+
+static bool BakeFile(const fs::path& path, BakedAsset& asset) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        fprintf(stderr, "Could not open %s\n", path.string().c_str());
+        return false;
+    }
+    asset.entry.type = ARCHIVE_FILE;
+    asset.data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static bool WriteArchive(const std::string& path, std::vector<BakedAsset>& assets) {
+    std::sort(assets.begin(), assets.end(), [](const BakedAsset& a, const BakedAsset& b) {
+        return std::string_view(a.entry.name) < std::string_view(b.entry.name);
+    });
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "Could not create %s\n", path.c_str());
+        return false;
+    }
+    static const uint8_t padding[ARCHIVE_ALIGNMENT] = {};
+    auto align = [&](uint64_t offset) {
+        const uint64_t aligned = (offset + ARCHIVE_ALIGNMENT - 1) / ARCHIVE_ALIGNMENT * ARCHIVE_ALIGNMENT;
+        fwrite(padding, 1, aligned - offset, file);
+        return aligned;
+    };
+
+    ArchiveHeader header = {};
+    fwrite(&header, sizeof(header), 1, file);
+    uint64_t offset = sizeof(header);
+    for (BakedAsset& asset : assets) {
+        offset = align(offset);
+        asset.entry.offset = offset;
+        asset.entry.size = asset.data.size();
+        fwrite(asset.data.data(), 1, asset.data.size(), file);
+        offset += asset.data.size();
+    }
+    offset = align(offset);
+    for (const BakedAsset& asset : assets) {
+        fwrite(&asset.entry, sizeof(asset.entry), 1, file);
+    }
+
+    memcpy(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    header.version = ARCHIVE_VERSION;
+    header.numEntries = uint32_t(assets.size());
+    header.indexOffset = offset;
+    header.fileSize = offset + assets.size() * sizeof(ArchiveEntry);
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+    const bool ok = ferror(file) == 0;
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "Error writing %s\n", path.c_str());
+    }
+    return ok;
+}
+
+static int ConvertTilemap(const char* input, const char* output) {
+    Tilemap tilemap;
+    const bool ok = tilemap.LoadCsv(input) && tilemap.Save(output);
+    Logger::Flush();
+    if (!ok) {
+        return 1;
+    }
+    printf("Converted %s (%dx%d tiles) to %s\n", input, tilemap.GetNumCols(), tilemap.GetNumRows(), output);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 4 && std::string(argv[1]) == "--tilemap") {
+        return ConvertTilemap(argv[2], argv[3]);
+    }
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <assets dir> <archive>\n", argv[0]);
+        fprintf(stderr, "       %s --tilemap <map.map> <map.tmb>\n", argv[0]);
+        return 1;
+    }
+    const fs::path root = argv[1];
+    if (!fs::is_directory(root)) {
+        fprintf(stderr, "%s is not a directory\n", argv[1]);
+        return 1;
+    }
+    IMG_Init(IMG_INIT_PNG);
+
+    std::vector<BakedAsset> assets;
+    uint64_t sourceBytes = 0;
+    for (const auto& file : fs::recursive_directory_iterator(root)) {
+        if (!file.is_regular_file()) {
+            continue;
+        }
+        const std::string name = file.path().lexically_relative(root).generic_string();
+        const std::string extension = file.path().extension().string();
+        BakedAsset asset = {};
+        bool ok;
+        if (extension == ".png") {
+            ok = BakeImage(file.path(), asset);
+        } else if (extension == ".map") {
+            ok = BakeTilemap(file.path(), asset);
+        } else if (extension == ".ttf") {
+            ok = BakeFile(file.path(), asset);
+        } else {
+            printf("Skipping %s\n", name.c_str());
+            continue;
+        }
+        if (name.size() >= sizeof(asset.entry.name)) {
+            fprintf(stderr, "%s: the name is longer than %zu characters\n", name.c_str(), sizeof(asset.entry.name) - 1);
+            ok = false;
+        }
+        if (!ok) {
+            IMG_Quit();
+            Logger::Flush();
+            return 1;
+        }
+        memcpy(asset.entry.name, name.c_str(), name.size() + 1);
+        sourceBytes += file.file_size();
+        assets.push_back(std::move(asset));
+    }
+    IMG_Quit();
+
+    if (!WriteArchive(argv[2], assets)) {
+        return 1;
+    }
+    printf("Baked %zu assets (%.1f KiB of source files) into %s (%.1f KiB)\n",
+           assets.size(), sourceBytes / 1024.0, argv[2], fs::file_size(argv[2]) / 1024.0);
+    return 0;
+}
@@ -0,0 +1,119 @@
+// Prints what a flight recorder file (see FlightRecorder.h) holds: frame
+// time stats with the worst hitches, the log messages and optionally the
+// profiler scopes as a Chrome trace.
+//
+// Usage: 2dge_flightdump <file> [--trace out.json] [--hitches N]
+#include "Logger/FlightRecorder.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <vector>
+
+static const char* const LEVEL_PREFIXES[] = {"TRC", "DBG", "LOG", "WRN", "ERR"};
+
+static std::string TimeOfDay(int64_t timestampUs) {
+    const time_t seconds = time_t(timestampUs / 1000000);
+    tm local;
+    localtime_r(&seconds, &local);
+    char text[32];
+    const size_t length = strftime(text, sizeof(text), "%H:%M:%S", &local);
+    snprintf(text + length, sizeof(text) - length, ".%03d", int(timestampUs / 1000 % 1000));
+    return text;
+}
+
+static void PrintFrames(const FlightRecorder::Recording& recording, int numHitches) {
+    const auto& frames = recording.frames;
+    if (frames.empty()) {
+        printf("No frames recorded\n");
+        return;
+    }
+    std::vector<float> frameMs;
+    for (const auto& frame : frames) {
+        frameMs.push_back(frame.frameMs);
+    }
+    std::sort(frameMs.begin(), frameMs.end());
+    printf("%zu frames from %s to %s: p50 %.3f ms  p99 %.3f ms  max %.3f ms\n",
+           frames.size(), TimeOfDay(frames.front().timestampUs).c_str(), TimeOfDay(frames.back().timestampUs).c_str(),
+           frameMs[frameMs.size() / 2], frameMs[frameMs.size() * 99 / 100], frameMs.back());
+
+    std::vector<const FlightRecorder::FrameRecord*> worst;
+    for (const auto& frame : frames) {
+        worst.push_back(&frame);
+    }
+    const size_t count = std::min<size_t>(numHitches, worst.size());
+    std::partial_sort(worst.begin(), worst.begin() + count, worst.end(), [](auto a, auto b) {
+        return a->frameMs > b->frameMs;
+    });
+    printf("Longest frames:\n");
+    for (size_t i = 0; i < count; i++) {
+        const auto& frame = *worst[i];
+        printf("  %s  frame %8.3f ms  update %7.3f  render %7.3f  present %7.3f  allocs %u  entities %u\n",
+               TimeOfDay(frame.timestampUs).c_str(), frame.frameMs, frame.updateMs, frame.renderMs,
+               frame.presentMs, frame.allocations, frame.numEntities);
+    }
+}
+
+static bool WriteTrace(const FlightRecorder::Recording& recording, const std::string& path) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        fprintf(stderr, "Could not open %s\n", path.c_str());
+        return false;
+    }
+    uint64_t epochNs = UINT64_MAX;
+    for (const auto& scope : recording.scopes) {
+        epochNs = std::min(epochNs, scope.beginNs);
+    }
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first = true;
+    for (const auto& scope : recording.scopes) {
+        // Chrome traces are in microseconds.
+        fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                first ? "" : ",\n", scope.name, scope.threadIndex,
+                (scope.beginNs - epochNs) / 1000.0, (scope.endNs - scope.beginNs) / 1000.0);
+        first = false;
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    printf("Wrote %zu profiler scopes to %s\n", recording.scopes.size(), path.c_str());
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <file> [--trace out.json] [--hitches N]\n", argv[0]);
+        return 2;
+    }
+    std::string tracePath;
+    int numHitches = 10;
+    for (int i = 2; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (arg == "--hitches" && i + 1 < argc) {
+            numHitches = std::max(0, std::atoi(argv[++i]));
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", arg.c_str());
+            return 2;
+        }
+    }
+
+    FlightRecorder::Recording recording;
+    if (!FlightRecorder::Read(argv[1], recording)) {
+        return 1;
+    }
+    printf("Session of process %u started at %s\n", recording.processId, TimeOfDay(recording.sessionStartUs).c_str());
+    PrintFrames(recording, numHitches);
+
+    printf("%zu log messages:\n", recording.logs.size());
+    for (const auto& log : recording.logs) {
+        printf("  %s %s: %.*s\n", TimeOfDay(log.timestampUs).c_str(), LEVEL_PREFIXES[std::min<int>(log.level, 4)],
+               int(log.length), log.text);
+    }
+
+    if (!tracePath.empty() && !WriteTrace(recording, tracePath)) {
+        return 1;
+    }
+    return 0;
+}
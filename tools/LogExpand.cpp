@@ -0,0 +1,26 @@
+// Expands a binary log dump written by the game (--log-dump FILE) into
+// text, one message per line.
+//
+// Usage: 2dge_logexpand <dump> [output]
+#include "Logger/Logger.h"
+#include <cstdio>
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s <dump> [output]\n", argv[0]);
+        return 2;
+    }
+    FILE* output = stdout;
+    if (argc == 3) {
+        output = fopen(argv[2], "w");
+        if (!output) {
+            fprintf(stderr, "Could not open %s\n", argv[2]);
+            return 1;
+        }
+    }
+    const bool ok = Logger::ExpandDump(argv[1], output);
+    if (output != stdout) {
+        fclose(output);
+    }
+    return ok ? 0 : 1;
+}